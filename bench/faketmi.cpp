@@ -0,0 +1,217 @@
+#include "ircparser.h"
+#include "irctags.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <memory>
+
+// Local stand-in for irc.chat.twitch.tv. It answers the CAP/PASS/NICK
+// handshake, echoes JOINs, answers PINGs and, after the first JOIN, replays
+// a recorded capture to the client. Point the app at it with the ircHost
+// and ircPort settings.
+
+struct CaptureLine {
+    qint64 offset;
+    QByteArray data;
+};
+
+struct Replay {
+    QList<CaptureLine> lines;
+    double speed = 1.0;
+    bool loop = false;
+};
+
+static QList<CaptureLine> loadCapture(const QString& path) {
+    QList<CaptureLine> lines;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return lines;
+    }
+    
+    // Pacing follows tmi-sent-ts; untagged lines keep the previous offset.
+    qint64 first = -1;
+    qint64 offset = 0;
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        
+        IrcMessage irc;
+        if (irc.parse(line)) {
+            qint64 sent = IrcTags(irc.tags).toInt(IrcTags::TmiSentTs);
+            if (sent > 0) {
+                if (first < 0) {
+                    first = sent;
+                }
+                offset = qMax(offset, sent - first);
+            }
+        }
+        lines.append({offset, line + "\r\n"});
+    }
+    return lines;
+}
+
+class Session {
+public:
+    Session(QTcpSocket* socket, const Replay& replay) : socket(socket), replay(replay) {
+        timer.setSingleShot(true);
+        QObject::connect(&timer, &QTimer::timeout, socket, [this]() { pump(); });
+        QObject::connect(socket, &QTcpSocket::readyRead, socket, [this]() { onReadyRead(); });
+        QObject::connect(socket, &QTcpSocket::bytesWritten, socket, [this]() {
+            if (this->replay.speed <= 0 && started && !timer.isActive()) {
+                timer.start(0);
+            }
+        });
+    }
+    
+    qint64 sent() const { return sentLines; }
+    qint64 elapsed() const { return started ? clock.elapsed() : 0; }
+    
+private:
+    static constexpr qint64 MaxPending = 4 * 1024 * 1024;
+    
+    QTcpSocket* socket;
+    const Replay& replay;
+    QTimer timer;
+    QElapsedTimer clock;
+    QByteArray readBuffer;
+    QByteArray nick = "justinfan";
+    bool started = false;
+    bool finished = false;
+    int next = 0;
+    qint64 loopBase = 0;
+    qint64 sentLines = 0;
+    
+    void onReadyRead() {
+        readBuffer.append(socket->readAll());
+        
+        qsizetype newline;
+        while ((newline = readBuffer.indexOf('\n')) >= 0) {
+            QByteArray line = readBuffer.left(newline).trimmed();
+            readBuffer.remove(0, newline + 1);
+            
+            IrcMessage irc;
+            if (line.isEmpty() || !irc.parse(line)) {
+                continue;
+            }
+            
+            if (irc.command == "NICK") {
+                nick = irc.param(0).toByteArray().toLower();
+                socket->write(":tmi.twitch.tv 001 " + nick + " :Welcome, GLHF!\r\n"
+                              ":tmi.twitch.tv 376 " + nick + " :>\r\n");
+            } else if (irc.command == "CAP") {
+                socket->write(":tmi.twitch.tv CAP * ACK :twitch.tv/tags twitch.tv/commands\r\n");
+            } else if (irc.command == "PING") {
+                socket->write(":tmi.twitch.tv PONG tmi.twitch.tv :" + (irc.hasTrailing ? irc.trailing : irc.param(0)).toByteArray() + "\r\n");
+            } else if (irc.command == "JOIN") {
+                QByteArray reply;
+                for (const QByteArray& channel : irc.param(0).toByteArray().split(',')) {
+                    reply += ":" + nick + "!" + nick + "@" + nick + ".tmi.twitch.tv JOIN " + channel + "\r\n";
+                    reply += "@emote-only=0;followers-only=-1;r9k=0;room-id=0;slow=0;subs-only=0 :tmi.twitch.tv ROOMSTATE " + channel + "\r\n";
+                }
+                socket->write(reply);
+                if (!started) {
+                    started = true;
+                    clock.start();
+                    pump();
+                }
+            }
+        }
+    }
+    
+    void pump() {
+        const QList<CaptureLine>& lines = replay.lines;
+        if (lines.isEmpty() || finished) {
+            return;
+        }
+        
+        QByteArray chunk;
+        bool unlimited = replay.speed <= 0;
+        qint64 now = qint64(clock.elapsed() * replay.speed);
+        while (true) {
+            if (next == lines.size()) {
+                if (!replay.loop) {
+                    break;
+                }
+                loopBase += lines.last().offset + 1;
+                next = 0;
+            }
+            if (unlimited ? socket->bytesToWrite() + chunk.size() > MaxPending
+                          : loopBase + lines[next].offset > now) {
+                break;
+            }
+            chunk += lines[next++].data;
+            sentLines++;
+        }
+        
+        if (!chunk.isEmpty()) {
+            socket->write(chunk);
+        }
+        
+        if (next < lines.size() || replay.loop) {
+            if (!unlimited) {
+                qint64 due = loopBase + lines[next % lines.size()].offset;
+                timer.start(int(qMax<qint64>(0, (due - now) / replay.speed)));
+            }
+        } else {
+            finished = true;
+            QTextStream(stdout) << "replayed " << sentLines << " lines in " << clock.elapsed() << " ms\n";
+        }
+    }
+};
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays a recorded Twitch IRC capture to local clients.");
+    parser.addHelpOption();
+    parser.addOption({"port", "Port to listen on.", "port", "6667"});
+    parser.addOption({"speed", "Replay speed: 1 for real time, N for N times, max for as fast as the socket drains.", "speed", "1"});
+    parser.addOption({"loop", "Start over when the capture ends."});
+    parser.addPositionalArgument("capture", "Recorded IRC lines, one per line.");
+    parser.process(app);
+    
+    QStringList args = parser.positionalArguments();
+    Replay replay;
+    replay.lines = loadCapture(args.isEmpty() ? QStringLiteral(BENCH_CORPUS) : args.first());
+    replay.speed = parser.value("speed") == "max" ? 0 : parser.value("speed").toDouble();
+    replay.loop = parser.isSet("loop");
+    
+    if (replay.lines.isEmpty()) {
+        out << "capture is empty or unreadable\n";
+        return 1;
+    }
+    if (replay.speed < 0 || (replay.speed == 0 && parser.value("speed") != "max")) {
+        out << "invalid speed " << parser.value("speed") << "\n";
+        return 1;
+    }
+    
+    QTcpServer server;
+    if (!server.listen(QHostAddress::LocalHost, quint16(parser.value("port").toUInt()))) {
+        out << "cannot listen: " << server.errorString() << "\n";
+        return 1;
+    }
+    out << "fake TMI on 127.0.0.1:" << server.serverPort() << ", " << replay.lines.size() << " lines\n";
+    out.flush();
+    
+    QObject::connect(&server, &QTcpServer::newConnection, &server, [&server, &replay]() {
+        while (QTcpSocket* socket = server.nextPendingConnection()) {
+            auto session = std::make_shared<Session>(socket, replay);
+            QObject::connect(socket, &QTcpSocket::disconnected, socket, [socket, session]() {
+                QTextStream(stdout) << "client left after " << session->sent() << " lines in "
+                                    << session->elapsed() << " ms\n";
+                socket->deleteLater();
+            });
+        }
+    });
+    
+    return app.exec();
+}
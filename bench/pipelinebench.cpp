@@ -0,0 +1,222 @@
+#include "ircparser.h"
+#include "irctags.h"
+#include "ircconnection.h"
+#include "emotemanager.h"
+#include "messagestore.h"
+#include "messageformatter.h"
+#include "emoteatlas.h"
+#include "settings.h"
+#include <QGuiApplication>
+#include <QPainter>
+#include <QImage>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counts every heap allocation made while a stage runs. On glibc malloc
+// itself is wrapped, which also catches Qt's container allocations; other
+// platforms only see operator new.
+static std::atomic<quint64> allocations{0};
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+}
+#else
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+#endif
+
+static qint64 sink = 0;
+
+template <typename Fn>
+static void run(QTextStream& out, const char* name, int messages, int iterations, Fn&& fn) {
+    for (int i = 0; i < messages; ++i) {
+        fn(i);
+    }
+    
+    quint64 before = allocations.load(std::memory_order_relaxed);
+    QElapsedTimer timer;
+    timer.start();
+    for (int n = 0; n < iterations; ++n) {
+        for (int i = 0; i < messages; ++i) {
+            fn(i);
+        }
+    }
+    qint64 ns = timer.nsecsElapsed();
+    quint64 allocated = allocations.load(std::memory_order_relaxed) - before;
+    
+    double total = double(messages) * iterations;
+    out << QString("%1 %2 ns/msg %3 allocs/msg %4 msg/s\n")
+           .arg(QString::fromLatin1(name), -18)
+           .arg(ns / total, 10, 'f', 1)
+           .arg(allocated / total, 8, 'f', 2)
+           .arg(total * 1e9 / qMax<qint64>(1, ns), 12, 'f', 0);
+}
+
+int main(int argc, char* argv[]) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    
+    QStringList args = app.arguments();
+    QString path = args.size() > 1 ? args[1] : QStringLiteral(BENCH_CORPUS);
+    int iterations = args.size() > 2 ? args[2].toInt() : 2000;
+    
+    QTextStream out(stdout);
+    
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        out << "cannot open corpus " << path << "\n";
+        return 1;
+    }
+    
+    QList<QByteArray> lines;
+    QList<IrcMessage> parsed;
+    QList<ChatMessage> messages;
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        IrcMessage irc;
+        if (irc.parse(line) && irc.command == "PRIVMSG") {
+            lines.append(line);
+        }
+    }
+    for (const QByteArray& line : lines) {
+        IrcMessage irc;
+        irc.parse(line);
+        parsed.append(irc);
+        messages.append(IrcConnection::parsePrivMsg(irc));
+    }
+    
+    if (lines.isEmpty() || iterations <= 0) {
+        out << "no PRIVMSG lines in " << path << "\n";
+        return 1;
+    }
+    
+    Settings& settings = Settings::instance();
+    settings.username = "benchuser";
+    settings.highlightedUsers = {"zephyrine"};
+    settings.highlightKeywords = {"clip", "benchuser", "insane"};
+    settings.publish();
+    std::shared_ptr<const SettingsSnapshot> snapshot = Settings::snapshot();
+    
+    const char* emoteNames[] = {"Kappa", "LUL", "PogChamp", "KEKW", "OMEGALUL", "Pog", "monkaS",
+                                "PepeHands", "4Head", "EZ", "Sadge", "catJAM", "Clap", "HeyGuys"};
+    for (const char* name : emoteNames) {
+        Emote* emote = new Emote();
+        emote->name = QString::fromLatin1(name);
+        emote->pixmap = QPixmap(56, 56);
+        emote->pixmap.fill(QColor::fromHsv(int(emote->name.size() * 40 % 360), 200, 200));
+        EmoteManager::instance().addEmote(emote);
+    }
+    const EmoteSet& emotes = EmoteManager::instance().globalEmotes();
+    
+    QList<ChatMessage> resolved = messages;
+    for (ChatMessage& msg : resolved) {
+        emotes.resolve(msg);
+    }
+    
+    int count = lines.size();
+    out << count << " messages x " << iterations << " iterations\n";
+    
+    run(out, "IrcMessage::parse", count, iterations, [&](int i) {
+        IrcMessage irc;
+        irc.parse(lines[i]);
+        sink += irc.paramCount;
+    });
+    
+    run(out, "IrcTags", count, iterations, [&](int i) {
+        IrcTags tags(parsed[i].tags);
+        sink += tags.value(IrcTags::DisplayName).size() + tags.raw(IrcTags::Color).size();
+    });
+    
+    run(out, "parsePrivMsg", count, iterations, [&](int i) {
+        sink += IrcConnection::parsePrivMsg(parsed[i]).text.size();
+    });
+    
+    MessageFormatter formatter;
+    FormattedMessage formatted;
+    run(out, "format", count, iterations, [&](int i) {
+        formatter.format(resolved[i], formatted);
+        sink += formatted.text.size() + formatted.formats.size();
+    });
+    
+    run(out, "shouldHighlight", count, iterations, [&](int i) {
+        sink += snapshot->shouldHighlight(messages[i]);
+    });
+    
+    run(out, "resolveEmotes", count, iterations, [&](int i) {
+        ChatMessage msg = messages[i];
+        emotes.resolve(msg);
+        sink += msg.emotes.size();
+    });
+    
+    MessageStore store;
+    run(out, "store append", count, iterations, [&](int i) {
+        sink += qint64(store.append(resolved[i]));
+    });
+    
+    run(out, "store message", count, iterations, [&](int i) {
+        sink += store.message(store.endSeq() - 1 - quint64(i) % quint64(store.size())).text.size();
+    });
+    out << QString("store %1 msgs, %2 bytes/msg\n").arg(store.size()).arg(store.bytesPerMessage(), 0, 'f', 1);
+    
+    QImage canvas(28 * 16, 28, QImage::Format_ARGB32_Premultiplied);
+    QPainter painter(&canvas);
+    QList<Emote*> blitEmotes;
+    for (const char* name : emoteNames) {
+        blitEmotes.append(emotes.find(QString::fromLatin1(name)));
+    }
+    run(out, "emote blit", count, iterations, [&](int i) {
+        Emote* emote = blitEmotes[i % blitEmotes.size()];
+        EmoteAtlas::instance().draw(&painter, QRectF(i % 16 * 28, 0, 28, 28), emote, 100);
+        sink += emote->width;
+    });
+    painter.end();
+    
+    run(out, "line to runs", count, iterations, [&](int i) {
+        IrcMessage irc;
+        irc.parse(lines[i]);
+        ChatMessage msg = IrcConnection::parsePrivMsg(irc);
+        emotes.resolve(msg);
+        formatter.format(msg, formatted);
+        sink += formatted.text.size();
+    });
+    
+    out << "(checksum " << sink << ")\n";
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "irctags.h"
+#include <QFile>
+#include <QMap>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+// The QMap-based parser TwitchChat used before IrcTags, kept verbatim so the
+// two can be compared on the same input.
+static QMap<QString, QString> legacyParseTags(const QString& tags) {
+    QMap<QString, QString> result;
+    
+    QStringList pairs = tags.split(";");
+    for (const QString& pair : pairs) {
+        int eq = pair.indexOf("=");
+        if (eq > 0) {
+            QString key = pair.left(eq);
+            QString value = pair.mid(eq + 1);
+            result[key] = value;
+        }
+    }
+    
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    QString path = argc > 1 ? QString::fromLocal8Bit(argv[1]) : QStringLiteral(BENCH_CORPUS);
+    int iterations = argc > 2 ? QByteArray(argv[2]).toInt() : 20000;
+    
+    QTextStream out(stdout);
+    
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        out << "cannot open corpus " << path << "\n";
+        return 1;
+    }
+    
+    QList<QByteArray> rawTags;
+    QStringList legacyTags;
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        int space = line.indexOf(' ');
+        if (!line.startsWith('@') || space < 0) {
+            continue;
+        }
+        rawTags.append(line.mid(1, space - 1));
+        legacyTags.append(QString::fromUtf8(rawTags.last()));
+    }
+    
+    if (rawTags.isEmpty() || iterations <= 0) {
+        out << "no tagged lines in " << path << "\n";
+        return 1;
+    }
+    
+    qint64 sink = 0;
+    QElapsedTimer timer;
+    
+    timer.start();
+    for (int i = 0; i < iterations; ++i) {
+        for (const QString& tags : legacyTags) {
+            QMap<QString, QString> tagMap = legacyParseTags(tags);
+            sink += tagMap.value("id").size();
+            sink += tagMap.value("display-name").size();
+            sink += tagMap.value("user-id").size();
+            sink += tagMap.value("color").size();
+            sink += tagMap.value("badges").size();
+        }
+    }
+    qint64 legacyNs = timer.nsecsElapsed();
+    
+    timer.restart();
+    for (int i = 0; i < iterations; ++i) {
+        for (const QByteArray& raw : rawTags) {
+            IrcTags tags(raw);
+            sink += tags.value(IrcTags::Id).size();
+            sink += tags.value(IrcTags::DisplayName).size();
+            sink += tags.value(IrcTags::UserId).size();
+            sink += tags.raw(IrcTags::Color).size();
+            sink += tags.raw(IrcTags::Badges).size();
+        }
+    }
+    qint64 flatNs = timer.nsecsElapsed();
+    
+    double messages = double(iterations) * rawTags.size();
+    out << "corpus:   " << rawTags.size() << " tagged lines x " << iterations << " iterations\n";
+    out << "QMap:     " << legacyNs / messages << " ns/message\n";
+    out << "IrcTags:  " << flatNs / messages << " ns/message\n";
+    out << "speedup:  " << double(legacyNs) / double(flatNs) << "x\n";
+    out << "checksum: " << sink << "\n";
+    
+    return 0;
+}
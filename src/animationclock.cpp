@@ -0,0 +1,81 @@
+#include "animationclock.h"
+#include "settings.h"
+#include <QTimer>
+#include <QWidget>
+#include <QWindow>
+#include <QAbstractScrollArea>
+
+AnimationClock& AnimationClock::instance() {
+    static AnimationClock inst;
+    return inst;
+}
+
+AnimationClock::AnimationClock() {
+    clock.start();
+    timer = new QTimer(this);
+    timer->setInterval(TickInterval);
+    connect(timer, &QTimer::timeout, this, &AnimationClock::tick);
+}
+
+void AnimationClock::addRegion(const QWidget* widget, const QRect& rect) {
+    if (!widget || !Settings::snapshot()->animatedEmotes) {
+        return;
+    }
+    
+    QWidget* target = const_cast<QWidget*>(widget);
+    if (!regions.contains(target)) {
+        connect(target, &QObject::destroyed, this, [this, target]() {
+            regions.remove(target);
+        });
+    }
+    regions[target] += rect;
+    
+    if (!timer->isActive()) {
+        timer->start();
+    }
+}
+
+// Called as a view starts painting rect, before its rows re-add themselves.
+void AnimationClock::clearRegion(const QWidget* widget, const QRect& rect) {
+    auto it = regions.find(const_cast<QWidget*>(widget));
+    if (it != regions.end()) {
+        *it -= rect;
+    }
+}
+
+bool AnimationClock::isShowing(QWidget* widget) {
+    if (!widget->isVisible()) {
+        return false;
+    }
+    QWidget* window = widget->window();
+    if (window->isMinimized()) {
+        return false;
+    }
+    QWindow* handle = window->windowHandle();
+    return !handle || handle->isExposed();
+}
+
+void AnimationClock::tick() {
+    if (!Settings::snapshot()->animatedEmotes) {
+        for (QRegion& region : regions) {
+            region = QRegion();
+        }
+        timer->stop();
+        return;
+    }
+    
+    bool active = false;
+    for (auto it = regions.begin(); it != regions.end(); ++it) {
+        if (it->isEmpty() || !isShowing(it.key())) {
+            continue;
+        }
+        QAbstractScrollArea* area = qobject_cast<QAbstractScrollArea*>(it.key());
+        QWidget* surface = area ? area->viewport() : it.key();
+        surface->update(*it);
+        active = true;
+    }
+    
+    if (!active) {
+        timer->stop();
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef ANIMATIONCLOCK_H
+#define ANIMATIONCLOCK_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QRegion>
+
+class QTimer;
+class QWidget;
+
+// One app-wide timer for animated emotes. Views report where they painted
+// an animated emote; each tick repaints just those rects in views that are
+// actually on screen. The timer stops once nothing visible is animating
+// or the published snapshot turns animatedEmotes off, and the next paint
+// restarts it.
+class AnimationClock : public QObject {
+    Q_OBJECT
+    
+public:
+    static AnimationClock& instance();
+    
+    qint64 now() const { return clock.elapsed(); }
+    void addRegion(const QWidget* widget, const QRect& rect);
+    void clearRegion(const QWidget* widget, const QRect& rect);
+    
+private slots:
+    void tick();
+    
+private:
+    static constexpr int TickInterval = 20;
+    
+    AnimationClock();
+    
+    QElapsedTimer clock;
+    QTimer* timer;
+    QHash<QWidget*, QRegion> regions;
+    
+    static bool isShowing(QWidget* widget);
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef CHANNELFEED_H
+#define CHANNELFEED_H
+
+#include <QObject>
+#include <QList>
+#include "chatmessage.h"
+
+struct ChannelInfo {
+    QString channelName;
+    QString channelId;
+    int viewerCount = 0;
+    QString streamTitle;
+    QString streamCategory;
+    bool isLive = false;
+};
+
+// Per-channel endpoint of TwitchChat's router. Views connect to the feed of
+// the channel they show and never see traffic for any other channel.
+class ChannelFeed : public QObject {
+    Q_OBJECT
+    
+public:
+    ChannelFeed(int handle, const QString& name, QObject* parent = nullptr)
+        : QObject(parent), channelHandle(handle), channelName(name) {}
+    
+    int handle() const { return channelHandle; }
+    QString name() const { return channelName; }
+    
+signals:
+    void messagesReceived(const QList<ChatMessage>& messages);
+    void userNotice(const QString& message);
+    void messageDeleted(const QString& messageId);
+    void chatCleared(const QString& userId);
+    void channelInfoUpdated(const ChannelInfo& info);
+    
+private:
+    int channelHandle;
+    QString channelName;
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "chatdelegate.h"
+#include "emotemanager.h"
+#include "emoteatlas.h"
+#include "animationclock.h"
+#include "settings.h"
+#include <QPainter>
+#include <QtMath>
+
+ChatDelegate::ChatDelegate(ChatModel* model, QObject* parent)
+    : QStyledItemDelegate(parent), model(model), layouts(MaxLayouts) {
+    
+    connect(model, &QAbstractItemModel::rowsAboutToBeRemoved, this, [this](const QModelIndex&, int first, int last) {
+        for (int row = first; row <= last; ++row) {
+            invalidate(this->model->seqAt(row));
+        }
+    });
+    connect(model, &QAbstractItemModel::dataChanged, this, [this](const QModelIndex& topLeft, const QModelIndex& bottomRight) {
+        for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+            invalidate(this->model->seqAt(row));
+        }
+    });
+    connect(model, &QAbstractItemModel::modelReset, this, &ChatDelegate::clearCache);
+}
+
+// Rows laid out under an older snapshot may carry stale highlights, mute
+// strikes or timestamps. sizeHintChanged makes the view re-lay out and
+// repaint, so rows already on screen pick up the new settings too.
+void ChatDelegate::syncSettings() const {
+    if (settingsVersion == Settings::snapshotVersion()) {
+        return;
+    }
+    ChatDelegate* self = const_cast<ChatDelegate*>(this);
+    self->clearCache();
+    emit self->sizeHintChanged(QModelIndex());
+}
+
+ChatDelegate::RowLayout* ChatDelegate::rowLayout(const QStyleOptionViewItem& option, const QModelIndex& index) const {
+    syncSettings();
+    if (option.font != formatterFont) {
+        formatterFont = option.font;
+        formatter.refresh(formatterFont);
+        sizes.clear();
+        layouts.clear();
+    }
+    
+    quint64 seq = model->seqAt(index.row());
+    RowLayout* row = layouts.object(seq);
+    if (!row) {
+        row = new RowLayout();
+        formatter.format(model->message(index.row()), row->message);
+        
+        QTextOption textOption;
+        textOption.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+        row->layout.setFont(option.font);
+        row->layout.setTextOption(textOption);
+        row->layout.setText(row->message.text);
+        row->layout.setFormats(row->message.formats);
+        layouts.insert(seq, row);
+    }
+    
+    if (row->width != option.rect.width()) {
+        layoutLines(row, option.rect.width());
+    }
+    return row;
+}
+
+// Each line is as tall as the tallest emote on it; the text is centred
+// vertically within it, as are the emotes.
+void ChatDelegate::layoutLines(RowLayout* row, int width) const {
+    int padding = Settings::snapshot()->compactMode ? 0 : 2;
+    qreal y = padding;
+    
+    row->lines.clear();
+    row->layout.beginLayout();
+    for (;;) {
+        QTextLine line = row->layout.createLine();
+        if (!line.isValid()) {
+            break;
+        }
+        line.setLineWidth(qMax(1, width - 2 * padding));
+        
+        qreal height = line.height();
+        int end = line.textStart() + line.textLength();
+        for (const FormattedEmote& emote : row->message.emotes) {
+            if (emote.position >= line.textStart() && emote.position < end) {
+                height = qMax<qreal>(height, emote.size.height());
+            }
+        }
+        
+        line.setPosition(QPointF(padding, y + (height - line.height()) / 2));
+        row->lines.append({y, height});
+        y += height;
+    }
+    row->layout.endLayout();
+    
+    row->width = width;
+    row->height = qCeil(y) + padding;
+}
+
+QSize ChatDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const {
+    syncSettings();
+    int width = option.rect.width();
+    quint64 seq = model->seqAt(index.row());
+    
+    auto it = sizes.constFind(seq);
+    if (it != sizes.constEnd() && it->width == width && option.font == formatterFont) {
+        return QSize(width, it->height);
+    }
+    
+    int height = rowLayout(option, index)->height;
+    sizes.insert(seq, {width, height});
+    return QSize(width, height);
+}
+
+void ChatDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const {
+    RowLayout* row = rowLayout(option, index);
+    
+    painter->save();
+    painter->setClipRect(option.rect);
+    if (row->message.highlighted) {
+        painter->fillRect(option.rect, QColor(255, 255, 0, 51));
+    }
+    
+    painter->setPen(option.palette.color(QPalette::Text));
+    row->layout.draw(painter, option.rect.topLeft());
+    
+    std::shared_ptr<const SettingsSnapshot> settings = Settings::snapshot();
+    int scale = settings->emoteScale;
+    bool animate = settings->animatedEmotes;
+    qint64 now = AnimationClock::instance().now();
+    for (const FormattedEmote& emote : row->message.emotes) {
+        QTextLine line = row->layout.lineForTextPosition(emote.position);
+        if (!line.isValid()) {
+            continue;
+        }
+        const LineBox& box = row->lines[line.lineNumber()];
+        QPointF origin = option.rect.topLeft() + QPointF(line.cursorToX(emote.position),
+                                                         box.top + (box.height - emote.size.height()) / 2);
+        QRectF target(origin, QSizeF(emote.size));
+        
+        int frame = 0;
+        if (animate && emote.emote->animated) {
+            frame = EmoteManager::instance().frameIndex(emote.emote, now);
+            AnimationClock::instance().addRegion(option.widget, target.toAlignedRect());
+        }
+        EmoteAtlas::instance().draw(painter, target, emote.emote, scale, frame);
+    }
+    painter->restore();
+}
+
+void ChatDelegate::setEmotes(const EmoteSet* set) {
+    formatter.setEmotes(set);
+    clearCache();
+}
+
+void ChatDelegate::invalidate(quint64 seq) {
+    sizes.remove(seq);
+    layouts.remove(seq);
+}
+
+void ChatDelegate::clearCache() {
+    settingsVersion = Settings::snapshotVersion();
+    formatter.refresh(formatterFont);
+    sizes.clear();
+    layouts.clear();
+}
@@ -0,0 +1,63 @@
+#ifndef CHATDELEGATE_H
+#define CHATDELEGATE_H
+
+#include <QStyledItemDelegate>
+#include <QTextLayout>
+#include <QCache>
+#include <QHash>
+#include "chatmodel.h"
+#include "messageformatter.h"
+
+// Lays out and paints one chat row. Row heights are cached per seq together
+// with the width they were measured at, so a resize only re-measures rows
+// as they become visible. Laid-out rows are kept for the most recently
+// painted rows only. Both caches belong to one settings snapshot: once a
+// newer one is published they are dropped and the view is asked to lay
+// out again.
+class ChatDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+    
+public:
+    explicit ChatDelegate(ChatModel* model, QObject* parent = nullptr);
+    
+    void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+    
+    void setEmotes(const EmoteSet* set);
+    void invalidate(quint64 seq);
+    void clearCache();
+    
+private:
+    static constexpr int MaxLayouts = 256;
+    
+    struct RowSize {
+        int width;
+        int height;
+    };
+    
+    struct LineBox {
+        qreal top;
+        qreal height;
+    };
+    
+    struct RowLayout {
+        FormattedMessage message;
+        QTextLayout layout;
+        QList<LineBox> lines;
+        int width = -1;
+        int height = 0;
+    };
+    
+    ChatModel* model;
+    mutable MessageFormatter formatter;
+    mutable QFont formatterFont;
+    mutable QHash<quint64, RowSize> sizes;
+    mutable QCache<quint64, RowLayout> layouts;
+    mutable quint64 settingsVersion = 0;
+    
+    void syncSettings() const;
+    RowLayout* rowLayout(const QStyleOptionViewItem& option, const QModelIndex& index) const;
+    void layoutLines(RowLayout* row, int width) const;
+};
+
+#endif
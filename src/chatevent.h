@@ -0,0 +1,26 @@
+#ifndef CHATEVENT_H
+#define CHATEVENT_H
+
+#include <QString>
+#include "chatmessage.h"
+
+struct ChatEvent {
+    enum Type {
+        Message,
+        UserNotice,
+        MessageDeleted,
+        ChatCleared,
+        RoomState,
+        UserState,
+        Joined,
+        Raw
+    };
+    
+    Type type = Message;
+    int channelId = -1;
+    QString channel;
+    ChatMessage message;
+    QString text;
+};
+
+#endif
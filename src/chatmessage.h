@@ -5,21 +5,37 @@
 #include <QStringList>
 #include <QDateTime>
 #include <QColor>
+#include "usertable.h"
+
+// One emote occurrence in ChatMessage::text, as UTF-16 offsets [start, end).
+// Twitch emotes carry the id from the emotes tag; third-party (BTTV, FFZ,
+// 7TV) matches found by EmoteSet::resolve() have an empty id.
+struct EmoteRange {
+    int start = 0;
+    int end = 0;
+    QString id;
+};
 
 struct ChatMessage {
     QString id;
-    QString username;
-    QString displayName;
+    UserHandle user;
     QString text;
-    QColor color;
     QDateTime timestamp;
-    QStringList badges;
-    QStringList emotes;
+    QList<EmoteRange> emotes;
     bool deleted = false;
     bool isAction = false;
     bool highlighted = false;
-    QString userId;
     int bits = 0;
+    
+    // tmi-sent-ts in ms since epoch, then Latency::now() at each stage.
+    qint64 serverTime = 0;
+    qint64 readAt = 0;
+    qint64 parsedAt = 0;
+    qint64 dispatchedAt = 0;
+    qint64 paintedAt = 0;
+    
+    const ChatUser& sender() const { return UserTable::instance().user(user); }
+    QString emoteName(const EmoteRange& range) const { return text.mid(range.start, range.end - range.start); }
 };
 
 #endif
@@ -0,0 +1,70 @@
+#include "chatmodel.h"
+
+ChatModel::ChatModel(const MessageStore* store, QObject* parent)
+    : QAbstractListModel(parent), store(store), first(store->firstSeq()), end(store->endSeq()) {
+}
+
+int ChatModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : int(end - first);
+}
+
+QVariant ChatModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return QVariant();
+    }
+    
+    quint64 seq = seqAt(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+        return UserTable::instance().user(store->user(seq)).displayName + ": " + store->text(seq);
+    case SeqRole:
+        return QVariant::fromValue(seq);
+    default:
+        return QVariant();
+    }
+}
+
+int ChatModel::rowOf(quint64 seq) const {
+    return seq >= first && seq < end ? int(seq - first) : -1;
+}
+
+ChatMessage ChatModel::message(int row) const {
+    return store->message(seqAt(row));
+}
+
+// Evictions are always applied; new messages only when insert is set, which
+// lets a frozen view keep its rows while the store moves on.
+void ChatModel::sync(bool insert) {
+    quint64 storeFirst = store->firstSeq();
+    if (storeFirst > first) {
+        int count = int(qMin(storeFirst, end) - first);
+        if (count > 0) {
+            beginRemoveRows(QModelIndex(), 0, count - 1);
+            first += quint64(count);
+            endRemoveRows();
+        }
+        first = storeFirst;
+        end = qMax(end, first);
+    }
+    
+    if (insert && store->endSeq() > end) {
+        int rows = rowCount();
+        beginInsertRows(QModelIndex(), rows, rows + int(store->endSeq() - end) - 1);
+        end = store->endSeq();
+        endInsertRows();
+    }
+}
+
+void ChatModel::reset() {
+    beginResetModel();
+    first = store->firstSeq();
+    end = store->endSeq();
+    endResetModel();
+}
+
+void ChatModel::messageChanged(quint64 seq) {
+    int row = rowOf(seq);
+    if (row >= 0) {
+        emit dataChanged(index(row), index(row));
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef CHATMODEL_H
+#define CHATMODEL_H
+
+#include <QAbstractListModel>
+#include "messagestore.h"
+
+// List model over a MessageStore. Rows are the store's seqs from first to
+// end; sync() catches the model up after the store has appended or evicted
+// messages, so views only ever see whole-row inserts at the end and
+// removals from the front.
+class ChatModel : public QAbstractListModel {
+    Q_OBJECT
+    
+public:
+    enum Role {
+        SeqRole = Qt::UserRole + 1
+    };
+    
+    explicit ChatModel(const MessageStore* store, QObject* parent = nullptr);
+    
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    
+    quint64 seqAt(int row) const { return first + quint64(row); }
+    int rowOf(quint64 seq) const;
+    ChatMessage message(int row) const;
+    
+    void sync(bool insert);
+    void reset();
+    void messageChanged(quint64 seq);
+    
+private:
+    const MessageStore* store;
+    quint64 first = 0;
+    quint64 end = 0;
+};
+
+#endif
@@ -0,0 +1,263 @@
+#include "chatview.h"
+#include "animationclock.h"
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QWheelEvent>
+#include <algorithm>
+
+ChatView::ChatView(QWidget* parent) : QAbstractItemView(parent) {
+    setSelectionMode(QAbstractItemView::NoSelection);
+    setEditTriggers(QAbstractItemView::NoEditTriggers);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+}
+
+int ChatView::rowHeight(int row) const {
+    QStyleOptionViewItem option;
+    initViewItemOption(&option);
+    option.rect = QRect(0, 0, viewport()->width(), 0);
+    return qMax(1, itemDelegate()->sizeHint(option, model()->index(row, 0)).height());
+}
+
+// Walks up from the anchor until the viewport is covered, so the cost is
+// the number of rows on screen however long the scrollback is.
+QList<ChatView::VisibleRow> ChatView::visibleRows() const {
+    QList<VisibleRow> rows;
+    if (!model() || anchorRow < 0) {
+        return rows;
+    }
+    
+    int width = viewport()->width();
+    int height = viewport()->height();
+    int bottom = height + anchorOffset;
+    for (int row = anchorRow; row >= 0 && bottom > 0; --row) {
+        int h = rowHeight(row);
+        rows.append({row, QRect(0, bottom - h, width, h)});
+        bottom -= h;
+    }
+    std::reverse(rows.begin(), rows.end());
+    
+    // Less than a screenful above the anchor: top-align like a document and
+    // fill the rest with the rows below it.
+    if (bottom > 0) {
+        for (VisibleRow& visible : rows) {
+            visible.rect.translate(0, -bottom);
+        }
+        int top = rows.isEmpty() ? 0 : rows.last().rect.bottom() + 1;
+        int count = model()->rowCount();
+        for (int row = anchorRow + 1; row < count && top < height; ++row) {
+            int h = rowHeight(row);
+            rows.append({row, QRect(0, top, width, h)});
+            top += h;
+        }
+    }
+    return rows;
+}
+
+void ChatView::clampToTop() {
+    int height = viewport()->height();
+    int total = 0;
+    for (int row = anchorRow; row >= 0; --row) {
+        total += rowHeight(row);
+        if (total >= height + anchorOffset) {
+            return;
+        }
+    }
+    anchorOffset = qMax(0, total - height);
+}
+
+void ChatView::syncScrollBar(int rows) {
+    QScrollBar* bar = verticalScrollBar();
+    QSignalBlocker blocker(bar);
+    bar->setRange(0, qMax(0, rows - 1));
+    bar->setSingleStep(1);
+    bar->setPageStep(qMax(1, viewport()->height() / qMax(1, fontMetrics().height())));
+    bar->setValue(qMax(0, anchorRow));
+}
+
+// Positive deltas scroll towards older rows.
+void ChatView::scrollByPixels(int delta) {
+    if (!model() || anchorRow < 0) {
+        return;
+    }
+    
+    int last = model()->rowCount() - 1;
+    anchorOffset += delta;
+    while (anchorRow > 0 && anchorOffset >= rowHeight(anchorRow)) {
+        anchorOffset -= rowHeight(anchorRow);
+        anchorRow--;
+    }
+    while (anchorOffset < 0 && anchorRow < last) {
+        anchorRow++;
+        anchorOffset += rowHeight(anchorRow);
+    }
+    anchorOffset = qMax(0, anchorOffset);
+    clampToTop();
+    
+    followTail = anchorRow == last && anchorOffset == 0;
+    syncScrollBar(last + 1);
+    viewport()->update();
+}
+
+void ChatView::paintEvent(QPaintEvent* event) {
+    QElapsedTimer timer;
+    timer.start();
+    
+    QPainter painter(viewport());
+    QStyleOptionViewItem option;
+    initViewItemOption(&option);
+    option.widget = this;
+    AnimationClock::instance().clearRegion(this, event->rect());
+    
+    for (const VisibleRow& visible : visibleRows()) {
+        if (!visible.rect.intersects(event->rect())) {
+            continue;
+        }
+        option.rect = visible.rect;
+        itemDelegate()->paint(&painter, option, model()->index(visible.row, 0));
+    }
+    
+    paintCost = timer.nsecsElapsed();
+}
+
+void ChatView::wheelEvent(QWheelEvent* event) {
+    int delta = event->pixelDelta().y();
+    if (delta == 0) {
+        delta = event->angleDelta().y() * QApplication::wheelScrollLines() * fontMetrics().height() / 120;
+    }
+    scrollByPixels(delta);
+    event->accept();
+}
+
+// Heights are cached per width, so a resize keeps the bottom row anchored
+// and only re-measures what comes on screen.
+void ChatView::resizeEvent(QResizeEvent* event) {
+    QAbstractItemView::resizeEvent(event);
+    if (anchorRow >= 0) {
+        clampToTop();
+    }
+}
+
+void ChatView::updateGeometries() {
+    syncScrollBar(model() ? model()->rowCount() : 0);
+    QAbstractItemView::updateGeometries();
+}
+
+void ChatView::rowsInserted(const QModelIndex& parent, int start, int end) {
+    QAbstractItemView::rowsInserted(parent, start, end);
+    
+    int rows = model()->rowCount();
+    if (anchorRow < 0 || (followTail && stickToBottom)) {
+        anchorRow = rows - 1;
+        anchorOffset = 0;
+        followTail = true;
+    } else {
+        followTail = false;
+    }
+    syncScrollBar(rows);
+    viewport()->update();
+}
+
+void ChatView::rowsAboutToBeRemoved(const QModelIndex& parent, int start, int end) {
+    QAbstractItemView::rowsAboutToBeRemoved(parent, start, end);
+    
+    int count = end - start + 1;
+    int rows = model()->rowCount() - count;
+    if (anchorRow > end) {
+        anchorRow -= count;
+    } else if (anchorRow >= start) {
+        anchorRow = qMin(start, rows - 1);
+        anchorOffset = 0;
+    }
+    syncScrollBar(rows);
+    viewport()->update();
+}
+
+void ChatView::dataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QList<int>& roles) {
+    QAbstractItemView::dataChanged(topLeft, bottomRight, roles);
+    viewport()->update();
+}
+
+void ChatView::verticalScrollbarValueChanged(int value) {
+    QAbstractItemView::verticalScrollbarValueChanged(value);
+    if (!model() || value == anchorRow) {
+        return;
+    }
+    
+    anchorRow = value;
+    anchorOffset = 0;
+    clampToTop();
+    followTail = value == model()->rowCount() - 1;
+    viewport()->update();
+}
+
+void ChatView::reset() {
+    QAbstractItemView::reset();
+    anchorRow = model() ? model()->rowCount() - 1 : -1;
+    anchorOffset = 0;
+    followTail = true;
+    syncScrollBar(model() ? model()->rowCount() : 0);
+    viewport()->update();
+}
+
+QRect ChatView::visualRect(const QModelIndex& index) const {
+    for (const VisibleRow& visible : visibleRows()) {
+        if (visible.row == index.row()) {
+            return visible.rect;
+        }
+    }
+    return QRect();
+}
+
+QModelIndex ChatView::indexAt(const QPoint& point) const {
+    for (const VisibleRow& visible : visibleRows()) {
+        if (visible.rect.contains(point)) {
+            return model()->index(visible.row, 0);
+        }
+    }
+    return QModelIndex();
+}
+
+void ChatView::scrollTo(const QModelIndex& index, ScrollHint hint) {
+    if (!index.isValid()) {
+        return;
+    }
+    if (hint == EnsureVisible && viewport()->rect().contains(visualRect(index))) {
+        return;
+    }
+    
+    anchorRow = index.row();
+    anchorOffset = 0;
+    clampToTop();
+    
+    int rows = model()->rowCount();
+    followTail = anchorRow == rows - 1 && anchorOffset == 0;
+    syncScrollBar(rows);
+    viewport()->update();
+}
+
+QModelIndex ChatView::moveCursor(CursorAction, Qt::KeyboardModifiers) {
+    return QModelIndex();
+}
+
+int ChatView::horizontalOffset() const {
+    return 0;
+}
+
+int ChatView::verticalOffset() const {
+    return 0;
+}
+
+bool ChatView::isIndexHidden(const QModelIndex&) const {
+    return false;
+}
+
+void ChatView::setSelection(const QRect&, QItemSelectionModel::SelectionFlags) {
+}
+
+QRegion ChatView::visualRegionForSelection(const QItemSelection&) const {
+    return QRegion();
+}
@@ -0,0 +1,64 @@
+#ifndef CHATVIEW_H
+#define CHATVIEW_H
+
+#include <QAbstractItemView>
+
+// Bottom-anchored view for chat rows. Instead of a pixel offset into the
+// whole scrollback, the position is the row drawn at the bottom edge plus
+// how far it hangs below it, so appending or evicting rows never lays out
+// anything but the rows on screen. The scrollbar counts rows.
+class ChatView : public QAbstractItemView {
+    Q_OBJECT
+    
+public:
+    explicit ChatView(QWidget* parent = nullptr);
+    
+    QRect visualRect(const QModelIndex& index) const override;
+    void scrollTo(const QModelIndex& index, ScrollHint hint = EnsureVisible) override;
+    QModelIndex indexAt(const QPoint& point) const override;
+    void reset() override;
+    
+    bool isAtBottom() const { return followTail; }
+    void setStickToBottom(bool enabled) { stickToBottom = enabled; }
+    qint64 lastPaintCost() const { return paintCost; }
+    
+protected:
+    QModelIndex moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers modifiers) override;
+    int horizontalOffset() const override;
+    int verticalOffset() const override;
+    bool isIndexHidden(const QModelIndex& index) const override;
+    void setSelection(const QRect& rect, QItemSelectionModel::SelectionFlags command) override;
+    QRegion visualRegionForSelection(const QItemSelection& selection) const override;
+    
+    void paintEvent(QPaintEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void updateGeometries() override;
+    
+protected slots:
+    void rowsInserted(const QModelIndex& parent, int start, int end) override;
+    void rowsAboutToBeRemoved(const QModelIndex& parent, int start, int end) override;
+    void dataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight,
+                     const QList<int>& roles = QList<int>()) override;
+    void verticalScrollbarValueChanged(int value) override;
+    
+private:
+    struct VisibleRow {
+        int row;
+        QRect rect;
+    };
+    
+    int anchorRow = -1;
+    int anchorOffset = 0;
+    bool followTail = true;
+    bool stickToBottom = true;
+    qint64 paintCost = 0;
+    
+    int rowHeight(int row) const;
+    QList<VisibleRow> visibleRows() const;
+    void scrollByPixels(int delta);
+    void clampToTop();
+    void syncScrollBar(int rows);
+};
+
+#endif
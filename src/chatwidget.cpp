@@ -1,16 +1,16 @@
 #include "chatwidget.h"
 #include "settings.h"
 #include "emotemanager.h"
+#include "latency.h"
+#include "highlightmatcher.h"
 #include <QTimer>
 #include <QFile>
 #include <QTextStream>
-#include <QScrollBar>
-#include <QTextCursor>
-#include <QTextCharFormat>
-#include <QTextImageFormat>
+#include <QScreen>
 
 ChatWidget::ChatWidget(const QString& channel, TwitchChat* chat, QWidget* parent)
-    : QWidget(parent), channelName(channel), chatConnection(chat) {
+    : QWidget(parent), channelName(channel), chatConnection(chat),
+      emotes(EmoteManager::instance().acquireChannel(channel)) {
     
     QVBoxLayout* layout = new QVBoxLayout(this);
     layout->setContentsMargins(0, 0, 0, 0);
@@ -19,186 +19,151 @@ ChatWidget::ChatWidget(const QString& channel, TwitchChat* chat, QWidget* parent
     infoLabel->setWordWrap(true);
     layout->addWidget(infoLabel);
     
-    chatDisplay = new QTextEdit(this);
-    chatDisplay->setReadOnly(true);
-    chatDisplay->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
-    layout->addWidget(chatDisplay);
+    model = new ChatModel(&store, this);
+    delegate = new ChatDelegate(model, this);
+    delegate->setEmotes(emotes);
+    chatView = new ChatView(this);
+    chatView->setItemDelegate(delegate);
+    chatView->setModel(model);
+    chatView->viewport()->installEventFilter(this);
+    layout->addWidget(chatView);
+    
+    connect(&EmoteManager::instance(), &EmoteManager::emoteLoaded, this, [this](const QString& channel) {
+        if (!channel.isEmpty() && channel.compare(channelName, Qt::CaseInsensitive) != 0) {
+            return;
+        }
+        delegate->clearCache();
+        chatView->viewport()->update();
+    });
     
     updateTheme();
+    applyRetention();
+    
+    frameTimer = new QTimer(this);
+    frameTimer->setSingleShot(true);
+    frameTimer->setTimerType(Qt::PreciseTimer);
+    connect(frameTimer, &QTimer::timeout, this, &ChatWidget::commitFrame);
+    statsClock.start();
     
     statsTimer = new QTimer(this);
     connect(statsTimer, &QTimer::timeout, this, &ChatWidget::updateStats);
     statsTimer->start(5000);
 }
 
-void ChatWidget::onMessageReceived(const QString& channel, const ChatMessage& msg) {
-    if (channel.toLower() != channelName.toLower()) {
-        return;
-    }
-    
-    if (Settings::instance().mutedUsers.contains(msg.username.toLower())) {
-        return;
-    }
-    
-    if (frozen) {
-        messageBuffer.append(msg);
-        return;
-    }
-    
-    addMessage(msg);
-    
-    userMessageCounts[msg.username]++;
-    
-    for (const QString& word : msg.text.split(" ")) {
-        if (EmoteManager::instance().hasEmote(word)) {
-            emoteCounts[word]++;
-        }
-    }
+// Cached layouts point at the channel's emotes, which are freed with the
+// channel's last view, so they go before the set is released.
+ChatWidget::~ChatWidget() {
+    frameTimer->stop();
+    pending.clear();
+    delegate->clearCache();
+    EmoteManager::instance().releaseChannel(channelName);
+}
+
+void ChatWidget::onMessagesReceived(const QList<ChatMessage>& messages) {
+    addMessages(messages);
+}
+
+bool ChatWidget::isMuted(const ChatMessage& msg, const SettingsSnapshot& settings) const {
+    return settings.mutedUsers.contains(msg.sender().login);
 }
 
 void ChatWidget::addMessage(const ChatMessage& msg) {
-    QString html = formatMessage(msg);
-    
-    QTextCursor cursor = chatDisplay->textCursor();
-    cursor.movePosition(QTextCursor::End);
-    
-    bool atBottom = chatDisplay->verticalScrollBar()->value() == 
-                    chatDisplay->verticalScrollBar()->maximum();
-    
-    cursor.insertHtml(html);
-    
-    if (Settings::instance().autoScroll && atBottom) {
-        chatDisplay->verticalScrollBar()->setValue(
-            chatDisplay->verticalScrollBar()->maximum()
-        );
-    }
-    
-    messageCount++;
-    
-    if (Settings::instance().lowCpuMode && messageCount > 500) {
-        QTextCursor clearCursor(chatDisplay->document());
-        clearCursor.movePosition(QTextCursor::Start);
-        clearCursor.movePosition(QTextCursor::Down, QTextCursor::KeepAnchor, 100);
-        clearCursor.removeSelectedText();
-        messageCount -= 100;
-    }
+    addMessages(QList<ChatMessage>{msg});
 }
 
-QString ChatWidget::formatMessage(const ChatMessage& msg) {
-    QString html = "<div style='margin:2px 0;";
-    
-    if (shouldHighlight(msg)) {
-        html += "background-color: rgba(255, 255, 0, 0.2);";
+void ChatWidget::addMessages(const QList<ChatMessage>& messages) {
+    std::shared_ptr<const SettingsSnapshot> settings = Settings::snapshot();
+    for (const ChatMessage& msg : messages) {
+        if (!isMuted(msg, *settings)) {
+            pending.append(msg);
+        }
     }
-    
-    if (Settings::instance().compactMode) {
-        html += "line-height: 1.2;";
+    scheduleFrame();
+}
+
+int ChatWidget::frameInterval() const {
+    QScreen* display = screen();
+    double rate = display ? display->refreshRate() : 60.0;
+    return qMax(1, qRound(1000.0 / (rate > 0 ? rate : 60.0)));
+}
+
+// At most one commit per display frame, plus however many frames the last
+// commit asked to skip. An idle widget commits on the next event loop pass.
+void ChatWidget::scheduleFrame() {
+    if (pending.isEmpty() || frameTimer->isActive()) {
+        return;
     }
     
-    html += "'>";
-    
-    if (Settings::instance().showTimestamps) {
-        QString time = msg.timestamp.toString("hh:mm:ss");
-        html += QString("<span style='color: #999; font-size: 10px;'>%1</span> ").arg(time);
+    qint64 wait = 0;
+    if (lastFrame.isValid()) {
+        wait = qMax<qint64>(0, qint64(frameInterval()) * (1 + skipFrames) - lastFrame.elapsed());
     }
-    
-    for (const QString& badge : msg.badges) {
-        if (badge == "moderator") {
-            html += "<span style='color: #00ff00; font-weight: bold;'>[M]</span> ";
-        } else if (badge == "vip") {
-            html += "<span style='color: #ff00ff; font-weight: bold;'>[VIP]</span> ";
-        } else if (badge.startsWith("subscriber")) {
-            html += "<span style='color: #ff0000; font-weight: bold;'>[SUB]</span> ";
-        } else if (badge == "broadcaster") {
-            html += "<span style='color: #ffa500; font-weight: bold;'>[BROADCASTER]</span> ";
-        }
+    frameTimer->start(int(wait));
+}
+
+// Appends everything that arrived since the last frame in one go: one
+// store pass, one row insert and one scroll. A frame that overran its
+// budget (this commit plus the view's last paint) makes the next commits
+// wait that many extra frames, so an overloaded channel trades frame rate
+// for bigger batches instead of falling behind.
+void ChatWidget::commitFrame() {
+    if (pending.isEmpty()) {
+        return;
     }
     
-    QString nameColor = msg.color.name();
-    html += QString("<span style='color: %1; font-weight: bold;'>%2</span>: ")
-            .arg(nameColor)
-            .arg(msg.displayName.isEmpty() ? msg.username : msg.displayName);
+    QElapsedTimer cost;
+    cost.start();
     
-    QString text = msg.text;
-    text.replace("<", "&lt;").replace(">", "&gt;");
-    
-    if (Settings::instance().showEmotes) {
-        QStringList words = text.split(" ");
-        QStringList processedWords;
+    QList<ChatMessage> batch;
+    batch.swap(pending);
+    for (ChatMessage& msg : batch) {
+        emotes->resolve(msg);
+        store.append(msg);
         
-        for (const QString& word : words) {
-            if (EmoteManager::instance().hasEmote(word)) {
-                Emote* emote = EmoteManager::instance().getEmote(word);
-                if (emote) {
-                    int scale = Settings::instance().emoteScale;
-                    int width = emote->width * scale / 100;
-                    int height = emote->height * scale / 100;
-                    
-                    processedWords.append(QString("<img src='emote:%1' width='%2' height='%3' title='%4'/>")
-                                        .arg(word)
-                                        .arg(width)
-                                        .arg(height)
-                                        .arg(word));
-                } else {
-                    processedWords.append(word);
-                }
-            } else {
-                processedWords.append(word);
-            }
+        if (!frozen && unpainted.size() < MaxUnpainted) {
+            unpainted.append(msg);
         }
         
-        text = processedWords.join(" ");
-    }
-    
-    if (msg.isAction) {
-        html += QString("<span style='color: %1; font-style: italic;'>%2</span>")
-                .arg(nameColor)
-                .arg(text);
-    } else {
-        html += QString("<span>%1</span>").arg(text);
+        userMessageCounts[msg.sender().login]++;
+        
+        for (const EmoteRange& range : msg.emotes) {
+            emoteCounts[msg.emoteName(range)]++;
+        }
     }
+    model->sync(!frozen);
     
-    if (msg.deleted && Settings::instance().showDeletedMessages) {
-        html += " <span style='color: #ff0000; font-size: 10px;'>[DELETED]</span>";
-    }
+    batchSizes.record(batch.size());
+    frames++;
     
-    html += "</div>";
+    qint64 budget = qint64(frameInterval()) * 1000000;
+    qint64 frameCost = cost.nsecsElapsed() + chatView->lastPaintCost();
+    skipFrames = int(qMin<qint64>(MaxSkippedFrames, frameCost / budget));
+    skippedFrames += skipFrames;
+    lastFrame.start();
     
-    return html;
+    scheduleFrame();
 }
 
-bool ChatWidget::shouldHighlight(const ChatMessage& msg) {
-    if (Settings::instance().highlightedUsers.contains(msg.username.toLower())) {
-        return true;
-    }
-    
-    QString lowerText = msg.text.toLower();
-    for (const QString& keyword : Settings::instance().highlightKeywords) {
-        if (lowerText.contains(keyword.toLower())) {
-            return true;
+bool ChatWidget::eventFilter(QObject* watched, QEvent* event) {
+    if (event->type() == QEvent::Paint && watched == chatView->viewport() && !unpainted.isEmpty()) {
+        qint64 now = Latency::now();
+        for (ChatMessage& msg : unpainted) {
+            msg.paintedAt = now;
+            LatencyMonitor::instance().record(channelName, msg);
         }
+        unpainted.clear();
     }
-    
-    if (Settings::instance().highlightOwnMessages && 
-        msg.username.toLower() == Settings::instance().username.toLower()) {
-        return true;
-    }
-    
-    return false;
+    return QWidget::eventFilter(watched, event);
 }
 
-void ChatWidget::onChannelInfoUpdated(const QString& channel, const ChannelInfo& info) {
-    if (channel.toLower() != channelName.toLower()) {
-        return;
-    }
-    
+void ChatWidget::onChannelInfoUpdated(const ChannelInfo& info) {
     QString infoText;
     
     if (Settings::instance().showStreamInfo) {
         if (info.isLive) {
-            infoText += QString("<b>%1</b>").arg(info.streamTitle);
+            infoText += QString("<b>%1</b>").arg(info.streamTitle.toHtmlEscaped());
             if (!info.streamCategory.isEmpty()) {
-                infoText += QString(" - %1").arg(info.streamCategory);
+                infoText += QString(" - %1").arg(info.streamCategory.toHtmlEscaped());
             }
         } else {
             infoText += "<i>Stream Offline</i>";
@@ -221,13 +186,28 @@ void ChatWidget::updateTheme() {
         bg = QString("rgba(30, 30, 30, %1)").arg(opacity / 100.0);
     }
     
-    chatDisplay->setStyleSheet(QString(
-        "QTextEdit { background-color: %1; color: %2; border: none; font-size: %3px; font-family: '%4'; }"
+    chatView->setStickToBottom(Settings::instance().autoScroll);
+    chatView->setStyleSheet(QString(
+        "ChatView { background-color: %1; color: %2; border: none; font-size: %3px; font-family: '%4'; }"
     ).arg(bg).arg(fg).arg(Settings::instance().fontSize).arg(Settings::instance().customFont));
     
     infoLabel->setStyleSheet(QString(
         "QLabel { background-color: %1; color: %2; padding: 5px; border-bottom: 1px solid #333; }"
     ).arg(bg).arg(fg));
+    
+    delegate->clearCache();
+    chatView->viewport()->update();
+}
+
+// Low-CPU mode caps the message count further but keeps the byte limit.
+void ChatWidget::applyRetention() {
+    const Settings& settings = Settings::instance();
+    int messages = qMax(1, settings.scrollbackMessages);
+    if (settings.lowCpuMode) {
+        messages = qMin(messages, LowCpuScrollback);
+    }
+    store.setLimits(messages, qint64(qMax(1, settings.scrollbackMegabytes)) * 1024 * 1024);
+    model->sync(!frozen);
 }
 
 void ChatWidget::togglePause() {
@@ -238,19 +218,70 @@ void ChatWidget::toggleFreeze() {
     frozen = !frozen;
     
     if (!frozen) {
-        for (const ChatMessage& msg : messageBuffer) {
-            addMessage(msg);
-        }
-        messageBuffer.clear();
+        model->sync(true);
     }
 }
 
 void ChatWidget::clear() {
-    chatDisplay->clear();
-    messageCount = 0;
+    pending.clear();
+    store.clear();
+    model->reset();
+}
+
+void ChatWidget::markDeleted(quint64 seq) {
+    if (store.setDeleted(seq)) {
+        model->messageChanged(seq);
+    }
+}
+
+void ChatWidget::onMessageDeleted(const QString& messageId) {
+    quint64 seq = store.findId(messageId);
+    if (seq != MessageStore::NoSeq) {
+        markDeleted(seq);
+    }
+    
+    for (ChatMessage& msg : pending) {
+        if (msg.id == messageId) {
+            msg.deleted = true;
+        }
+    }
+}
+
+void ChatWidget::onChatCleared(const QString& userId) {
+    if (userId.isEmpty()) {
+        ChatMessage notice;
+        notice.user = UserTable::instance().system("*", QColor("#888888"));
+        notice.text = "Chat was cleared by a moderator";
+        notice.timestamp = QDateTime::currentDateTime();
+        addMessage(notice);
+        return;
+    }
+    
+    for (quint64 seq : store.findUser(userId)) {
+        markDeleted(seq);
+    }
+    
+    for (ChatMessage& msg : pending) {
+        if (msg.sender().userId == userId) {
+            msg.deleted = true;
+        }
+    }
 }
 
 void ChatWidget::updateStats() {
+    emit storeUsageChanged(channelName, store.usage());
+    
+    double seconds = qMax<qint64>(1, statsClock.restart()) / 1000.0;
+    RenderStats stats;
+    stats.framesPerSecond = frames / seconds;
+    stats.skippedPerSecond = skippedFrames / seconds;
+    stats.frameInterval = frameInterval();
+    stats.batchSize = batchSizes.summary();
+    emit renderStatsChanged(channelName, stats);
+    
+    frames = 0;
+    skippedFrames = 0;
+    batchSizes.reset();
 }
 
 void ChatWidget::exportLog(const QString& filepath) {
@@ -260,6 +291,12 @@ void ChatWidget::exportLog(const QString& filepath) {
     }
     
     QTextStream out(&file);
-    out << chatDisplay->toPlainText();
+    for (int row = 0; row < model->rowCount(); ++row) {
+        ChatMessage msg = model->message(row);
+        if (Settings::instance().showTimestamps) {
+            out << msg.timestamp.toString("hh:mm:ss") << " ";
+        }
+        out << msg.sender().displayName << ": " << msg.text << "\n";
+    }
     file.close();
 }
@@ -2,47 +2,88 @@
 #define CHATWIDGET_H
 
 #include <QWidget>
-#include <QTextEdit>
 #include <QVBoxLayout>
 #include <QLabel>
 #include <QScrollBar>
+#include <QHash>
+#include <QElapsedTimer>
 #include "chatmessage.h"
 #include "twitchchat.h"
+#include "messagestore.h"
+#include "chatmodel.h"
+#include "chatview.h"
+#include "chatdelegate.h"
+#include "latency.h"
+#include "settings.h"
+
+class EmoteSet;
 
 class ChatWidget : public QWidget {
     Q_OBJECT
     
 public:
     explicit ChatWidget(const QString& channel, TwitchChat* chat, QWidget* parent = nullptr);
+    ~ChatWidget();
     
     void addMessage(const ChatMessage& msg);
+    void addMessages(const QList<ChatMessage>& messages);
     void clear();
     void updateTheme();
+    void applyRetention();
     void exportLog(const QString& filepath);
     QString getChannel() const { return channelName; }
     
+    const MessageStore& messageStore() const { return store; }
+    
+signals:
+    void storeUsageChanged(const QString& channel, const StoreUsage& usage);
+    void renderStatsChanged(const QString& channel, const RenderStats& stats);
+    
 public slots:
-    void onMessageReceived(const QString& channel, const ChatMessage& msg);
-    void onChannelInfoUpdated(const QString& channel, const ChannelInfo& info);
+    void onMessagesReceived(const QList<ChatMessage>& messages);
+    void onChannelInfoUpdated(const ChannelInfo& info);
+    void onMessageDeleted(const QString& messageId);
+    void onChatCleared(const QString& userId);
     void togglePause();
     void toggleFreeze();
     
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override;
+    
 private:
+    static constexpr int MaxUnpainted = 1000;
+    static constexpr int LowCpuScrollback = 500;
+    static constexpr int MaxSkippedFrames = 8;
+    
     QString channelName;
-    QTextEdit* chatDisplay;
+    ChatView* chatView;
+    ChatModel* model;
+    ChatDelegate* delegate;
     QLabel* infoLabel;
     TwitchChat* chatConnection;
-    QList<ChatMessage> messageBuffer;
+    const EmoteSet* emotes;
+    QList<ChatMessage> pending;
+    QList<ChatMessage> unpainted;
+    QTimer* frameTimer;
+    QElapsedTimer lastFrame;
+    QElapsedTimer statsClock;
+    int skipFrames = 0;
+    int frames = 0;
+    int skippedFrames = 0;
+    LatencyHistogram batchSizes;
+    MessageStore store;
     bool paused = false;
     bool frozen = false;
-    int messageCount = 0;
     QTimer* statsTimer;
     QMap<QString, int> userMessageCounts;
     QMap<QString, int> emoteCounts;
     
-    QString formatMessage(const ChatMessage& msg);
+    bool isMuted(const ChatMessage& msg, const SettingsSnapshot& settings) const;
+    void markDeleted(quint64 seq);
+    void scheduleFrame();
+    void commitFrame();
+    int frameInterval() const;
     void updateStats();
-    bool shouldHighlight(const ChatMessage& msg);
 };
 
 #endif
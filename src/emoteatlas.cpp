@@ -0,0 +1,150 @@
+#include "emoteatlas.h"
+#include "emotemanager.h"
+#include <QPainter>
+#include <QSet>
+#include <QtMath>
+
+EmoteAtlas& EmoteAtlas::instance() {
+    static EmoteAtlas inst;
+    return inst;
+}
+
+// Drops the entries and strips of emotes that are being freed, so a later
+// emote at the same address cannot pick them up. Their page space is
+// reclaimed the next time the pages are cleared.
+void EmoteAtlas::forget(const QList<Emote*>& emotes) {
+    if (emotes.isEmpty()) {
+        return;
+    }
+    QSet<const Emote*> gone(emotes.cbegin(), emotes.cend());
+    entries.removeIf([&gone](const QHash<Key, Entry>::iterator& it) {
+        return gone.contains(it.key().emote);
+    });
+    strips.removeIf([&gone](const QHash<Key, Strip>::iterator& it) {
+        return gone.contains(it.key().emote);
+    });
+}
+
+void EmoteAtlas::clear() {
+    clearPages();
+    strips.clear();
+}
+
+void EmoteAtlas::clearPages() {
+    entries.clear();
+    pages.clear();
+}
+
+// Shelf packing: an emote goes on the first shelf of its height or taller
+// with room left, otherwise it opens a new shelf below the last one.
+bool EmoteAtlas::allocate(const QSize& size, Entry& entry) {
+    for (int i = 0; i < pages.size(); ++i) {
+        Page& page = pages[i];
+        for (Shelf& shelf : page.shelves) {
+            if (size.height() <= shelf.height && shelf.x + size.width() <= PageSize) {
+                entry = {i, QRect(QPoint(shelf.x, shelf.y), size)};
+                shelf.x += size.width();
+                return true;
+            }
+        }
+        if (page.nextY + size.height() <= PageSize) {
+            page.shelves.append({page.nextY, size.height(), size.width()});
+            entry = {i, QRect(QPoint(0, page.nextY), size)};
+            page.nextY += size.height();
+            return true;
+        }
+    }
+    
+    if (pages.size() >= MaxPages) {
+        return false;
+    }
+    
+    Page page;
+    page.pixmap = QPixmap(PageSize, PageSize);
+    page.pixmap.fill(Qt::transparent);
+    page.shelves.append({0, size.height(), size.width()});
+    page.nextY = size.height();
+    pages.append(page);
+    entry = {int(pages.size()) - 1, QRect(QPoint(0, 0), size)};
+    return true;
+}
+
+bool EmoteAtlas::insert(const Key& key, const QPixmap& source, const QSize& size, Entry& entry) {
+    if (size.isEmpty() || size.width() > PageSize || size.height() > PageSize) {
+        return false;
+    }
+    
+    if (!allocate(size, entry)) {
+        clearPages();
+        if (!allocate(size, entry)) {
+            return false;
+        }
+    }
+    
+    QPixmap scaled = source.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    QPainter painter(&pages[entry.page].pixmap);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.drawPixmap(entry.rect.topLeft(), scaled);
+    painter.end();
+    
+    entries.insert(key, entry);
+    return true;
+}
+
+// A frame of a decoded animation, scaled on its first use and then kept
+// for as long as the emote is shown at this size.
+const QPixmap& EmoteAtlas::stripFrame(const Key& key, const Emote* emote, const QSize& size, int frame) {
+    Strip& strip = strips[key];
+    if (strip.size != size || strip.frames.size() != emote->frames.size()) {
+        strip.size = size;
+        strip.frames = QList<QPixmap>(emote->frames.size());
+    }
+    
+    QPixmap& scaled = strip.frames[frame];
+    if (scaled.isNull()) {
+        scaled = emote->frames[frame].scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    return scaled;
+}
+
+void EmoteAtlas::draw(QPainter* painter, const QRectF& target, const Emote* emote, int scale, int frame) {
+    if (!emote) {
+        return;
+    }
+    
+    bool animation = frame >= 0 && frame < emote->frames.size();
+    const QPixmap& source = animation ? emote->frames[frame] : emote->pixmap;
+    if (source.isNull()) {
+        return;
+    }
+    
+    if (scale != currentScale) {
+        clear();
+        currentScale = scale;
+    }
+    
+    qreal dpr = painter->device() ? painter->device()->devicePixelRatio() : 1.0;
+    Key key{emote, scale, qRound(dpr * 100)};
+    QSize size(qCeil(target.width() * dpr), qCeil(target.height() * dpr));
+    
+    if (animation) {
+        if (size.isEmpty()) {
+            painter->drawPixmap(target, source, source.rect());
+            return;
+        }
+        const QPixmap& scaled = stripFrame(key, emote, size, frame);
+        painter->drawPixmap(target, scaled, scaled.rect());
+        return;
+    }
+    
+    auto it = entries.constFind(key);
+    Entry entry;
+    if (it != entries.constEnd()) {
+        entry = it.value();
+    } else if (!insert(key, source, size, entry)) {
+        painter->drawPixmap(target, source, source.rect());
+        return;
+    }
+    
+    painter->drawPixmap(target, pages[entry.page].pixmap, entry.rect);
+}
@@ -0,0 +1,82 @@
+#ifndef EMOTEATLAS_H
+#define EMOTEATLAS_H
+
+#include <QPixmap>
+#include <QHash>
+#include <QList>
+#include <QRect>
+
+class QPainter;
+struct Emote;
+
+// Emote images pre-scaled to their on-screen size and packed into a few
+// shared pixmap pages, so drawing an emote is one sub-rect blit. Entries
+// are keyed by emote, scale and device pixel ratio; a change of the emote
+// scale setting drops every page, and so does running out of pages.
+// Decoded animations stay out of the pages: each gets a strip of its own
+// frames, every frame scaled the first time it is shown. Emotes that are
+// about to be freed must be forgotten first.
+class EmoteAtlas {
+public:
+    static EmoteAtlas& instance();
+    
+    void draw(QPainter* painter, const QRectF& target, const Emote* emote, int scale, int frame = 0);
+    void forget(const QList<Emote*>& emotes);
+    void clear();
+    int pageCount() const { return pages.size(); }
+    int entryCount() const { return entries.size(); }
+    
+private:
+    static constexpr int PageSize = 1024;
+    static constexpr int MaxPages = 8;
+    
+    struct Key {
+        const Emote* emote;
+        int scale;
+        int dpr;
+        
+        bool operator==(const Key& other) const {
+            return emote == other.emote && scale == other.scale && dpr == other.dpr;
+        }
+    };
+    
+    struct Entry {
+        int page;
+        QRect rect;
+    };
+    
+    struct Shelf {
+        int y;
+        int height;
+        int x;
+    };
+    
+    struct Page {
+        QPixmap pixmap;
+        QList<Shelf> shelves;
+        int nextY = 0;
+    };
+    
+    struct Strip {
+        QSize size;
+        QList<QPixmap> frames;
+    };
+    
+    EmoteAtlas() = default;
+    
+    QHash<Key, Entry> entries;
+    QList<Page> pages;
+    QHash<Key, Strip> strips;
+    int currentScale = -1;
+    
+    bool allocate(const QSize& size, Entry& entry);
+    bool insert(const Key& key, const QPixmap& source, const QSize& size, Entry& entry);
+    void clearPages();
+    const QPixmap& stripFrame(const Key& key, const Emote* emote, const QSize& size, int frame);
+    
+    friend size_t qHash(const Key& key, size_t seed) {
+        return qHashMulti(seed, quintptr(key.emote), key.scale, key.dpr);
+    }
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "emotemanager.h"
+#include "emoteatlas.h"
 #include "constants.h"
 #include <QNetworkReply>
 #include <QJsonDocument>
@@ -8,6 +9,9 @@
 #include <QDir>
 #include <QFile>
 #include <QImageReader>
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <algorithm>
 
 EmoteManager& EmoteManager::instance() {
     static EmoteManager inst;
@@ -16,6 +20,7 @@ EmoteManager& EmoteManager::instance() {
 
 EmoteManager::EmoteManager() {
     nam = new QNetworkAccessManager(this);
+    decoder.setMaxThreadCount(1);
     
     QString cachePath = getCachePath();
     QDir dir(cachePath);
@@ -28,6 +33,55 @@ QString EmoteManager::getCachePath() {
     return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/emotes";
 }
 
+// Cached images are named after their source URL: emote names are only
+// unique within a channel, and the image format is sniffed on load.
+QString EmoteManager::cacheFile(const QString& url) {
+    QByteArray hash = QCryptographicHash::hash(url.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return getCachePath() + "/" + QString::fromLatin1(hash);
+}
+
+// The layer an emote from channel goes into: the global set for an empty
+// channel, nullptr once no view holds that channel any more.
+EmoteSet* EmoteManager::layer(const QString& channel) {
+    if (channel.isEmpty()) {
+        return &global;
+    }
+    return channels.value(channel.toLower(), nullptr);
+}
+
+// The first view of a channel creates its set, seeded with the global
+// emotes, and starts the third-party loads; later views share it.
+const EmoteSet* EmoteManager::acquireChannel(const QString& channel) {
+    QString key = channel.toLower();
+    EmoteSet*& set = channels[key];
+    if (!set) {
+        set = new EmoteSet();
+        set->table = global.table;
+        loadBTTVEmotes(key);
+        loadFFZEmotes(key);
+        load7TVEmotes(key);
+    }
+    set->refs++;
+    return set;
+}
+
+// Drops the channel's emotes with its last view. Downloads still in flight
+// for it are discarded when they finish.
+void EmoteManager::releaseChannel(const QString& channel) {
+    auto it = channels.find(channel.toLower());
+    if (it == channels.end() || --it.value()->refs > 0) {
+        return;
+    }
+    
+    EmoteSet* set = it.value();
+    channels.erase(it);
+    for (Emote* emote : std::as_const(set->own)) {
+        decoding.remove(emote);
+    }
+    EmoteAtlas::instance().forget(set->own.values());
+    delete set;
+}
+
 void EmoteManager::loadTwitchGlobalEmotes(const QString& token) {
     QUrl url("https://api.twitch.tv/helix/chat/emotes/global");
     QNetworkRequest req(url);
@@ -38,17 +92,19 @@ void EmoteManager::loadTwitchGlobalEmotes(const QString& token) {
     connect(reply, &QNetworkReply::finished, this, &EmoteManager::handleTwitchEmotesResponse);
 }
 
-void EmoteManager::loadChannelEmotes(const QString& channelId, const QString& token) {
+void EmoteManager::loadChannelEmotes(const QString& channel, const QString& channelId, const QString& token) {
     QUrl url(QString("https://api.twitch.tv/helix/chat/emotes?broadcaster_id=%1").arg(channelId));
     QNetworkRequest req(url);
     req.setRawHeader("Authorization", QString("Bearer %1").arg(token).toUtf8());
     req.setRawHeader("Client-Id", TWITCH_APP_CLIENT_ID.toUtf8());
     
     QNetworkReply* reply = nam->get(req);
+    reply->setProperty("channel", channel);
     connect(reply, &QNetworkReply::finished, this, &EmoteManager::handleTwitchEmotesResponse);
 }
 
 void EmoteManager::handleTwitchEmotesResponse(QNetworkReply* reply) {
+    QString channel = reply->property("channel").toString();
     if (reply->error() != QNetworkReply::NoError) {
         reply->deleteLater();
         return;
@@ -74,7 +130,7 @@ void EmoteManager::handleTwitchEmotesResponse(QNetworkReply* reply) {
         QString format = emote["format"].toArray()[0].toString();
         bool animated = format == "animated";
         
-        downloadEmote(name, url, animated);
+        downloadEmote(channel, name, url, animated);
     }
 }
 
@@ -83,10 +139,12 @@ void EmoteManager::loadBTTVEmotes(const QString& channelName) {
     QNetworkRequest req(url);
     
     QNetworkReply* reply = nam->get(req);
+    reply->setProperty("channel", channelName);
     connect(reply, &QNetworkReply::finished, this, &EmoteManager::handleBTTVResponse);
 }
 
 void EmoteManager::handleBTTVResponse(QNetworkReply* reply) {
+    QString channel = reply->property("channel").toString();
     if (reply->error() != QNetworkReply::NoError) {
         reply->deleteLater();
         return;
@@ -100,7 +158,7 @@ void EmoteManager::handleBTTVResponse(QNetworkReply* reply) {
     QJsonArray channelEmotes = doc.object()["channelEmotes"].toArray();
     QJsonArray sharedEmotes = doc.object()["sharedEmotes"].toArray();
     
-    auto processEmotes = [this](const QJsonArray& arr) {
+    auto processEmotes = [this, &channel](const QJsonArray& arr) {
         for (const auto& item : arr) {
             QJsonObject emote = item.toObject();
             QString code = emote["code"].toString();
@@ -110,7 +168,7 @@ void EmoteManager::handleBTTVResponse(QNetworkReply* reply) {
             QString url = QString("https://cdn.betterttv.net/emote/%1/2x").arg(id);
             bool animated = imageType == "gif";
             
-            downloadEmote(code, url, animated);
+            downloadEmote(channel, code, url, animated);
         }
     };
     
@@ -123,10 +181,12 @@ void EmoteManager::loadFFZEmotes(const QString& channelName) {
     QNetworkRequest req(url);
     
     QNetworkReply* reply = nam->get(req);
+    reply->setProperty("channel", channelName);
     connect(reply, &QNetworkReply::finished, this, &EmoteManager::handleFFZResponse);
 }
 
 void EmoteManager::handleFFZResponse(QNetworkReply* reply) {
+    QString channel = reply->property("channel").toString();
     if (reply->error() != QNetworkReply::NoError) {
         reply->deleteLater();
         return;
@@ -154,7 +214,7 @@ void EmoteManager::handleFFZResponse(QNetworkReply* reply) {
                 url = "https:" + url;
             }
             
-            downloadEmote(name, url, false);
+            downloadEmote(channel, name, url, false);
         }
     }
 }
@@ -164,10 +224,12 @@ void EmoteManager::load7TVEmotes(const QString& channelName) {
     QNetworkRequest req(url);
     
     QNetworkReply* reply = nam->get(req);
+    reply->setProperty("channel", channelName);
     connect(reply, &QNetworkReply::finished, this, &EmoteManager::handle7TVResponse);
 }
 
 void EmoteManager::handle7TVResponse(QNetworkReply* reply) {
+    QString channel = reply->property("channel").toString();
     if (reply->error() != QNetworkReply::NoError) {
         reply->deleteLater();
         return;
@@ -191,46 +253,36 @@ void EmoteManager::handle7TVResponse(QNetworkReply* reply) {
         
         QString url = QString("https://cdn.7tv.app/emote/%1/2x.%2").arg(id).arg(animated ? "gif" : "webp");
         
-        downloadEmote(name, url, animated);
+        downloadEmote(channel, name, url, animated);
     }
 }
 
-void EmoteManager::downloadEmote(const QString& name, const QString& url, bool animated) {
-    if (emotes.contains(name)) {
+void EmoteManager::downloadEmote(const QString& channel, const QString& name, const QString& url, bool animated) {
+    EmoteSet* set = layer(channel);
+    if (!set || set->own.contains(name)) {
         return;
     }
     
-    QString cachePath = getCachePath();
-    QString ext = animated ? "gif" : "png";
-    QString filePath = QString("%1/%2.%3").arg(cachePath).arg(name).arg(ext);
-    
-    QFile file(filePath);
-    if (file.exists()) {
+    QFile file(cacheFile(url));
+    if (file.open(QIODevice::ReadOnly)) {
         Emote* emote = new Emote();
         emote->name = name;
         emote->animated = animated;
         emote->url = url;
+        loadImage(emote, file.readAll());
         
-        if (animated) {
-            emote->movie = new QMovie(filePath);
-            emote->movie->start();
-        } else {
-            emote->pixmap.load(filePath);
-        }
-        
-        emotes[name] = emote;
-        emit emoteLoaded(name);
+        addEmote(emote, channel);
         return;
     }
     
     QNetworkRequest req(QUrl(url));
     QNetworkReply* reply = nam->get(req);
-    pendingDownloads[reply] = name;
+    pendingDownloads[reply] = {channel, name};
     connect(reply, &QNetworkReply::finished, this, &EmoteManager::handleEmoteDownload);
 }
 
 void EmoteManager::handleEmoteDownload(QNetworkReply* reply) {
-    QString name = pendingDownloads.take(reply);
+    PendingEmote pending = pendingDownloads.take(reply);
     
     if (reply->error() != QNetworkReply::NoError) {
         reply->deleteLater();
@@ -238,42 +290,170 @@ void EmoteManager::handleEmoteDownload(QNetworkReply* reply) {
     }
     
     QByteArray data = reply->readAll();
-    QString url = reply->url().toString();
+    QString url = reply->request().url().toString();
     reply->deleteLater();
     
-    bool animated = url.endsWith(".gif");
-    
-    QString cachePath = getCachePath();
-    QString ext = animated ? "gif" : "png";
-    QString filePath = QString("%1/%2.%3").arg(cachePath).arg(name).arg(ext);
-    
-    QFile file(filePath);
+    QFile file(cacheFile(url));
     if (file.open(QIODevice::WriteOnly)) {
         file.write(data);
         file.close();
     }
     
     Emote* emote = new Emote();
-    emote->name = name;
-    emote->animated = animated;
+    emote->name = pending.name;
     emote->url = url;
     
-    if (animated) {
-        emote->movie = new QMovie(filePath);
-        emote->movie->start();
-    } else {
-        emote->pixmap.loadFromData(data);
-    }
+    loadImage(emote, data);
     
-    emotes[name] = emote;
-    emit emoteLoaded(name);
+    addEmote(emote, pending.channel);
     emit emotesUpdated();
 }
 
-Emote* EmoteManager::getEmote(const QString& name) {
-    return emotes.value(name, nullptr);
+// Only the first frame is decoded here; whether an emote animates is taken
+// from the image itself, since not every source URL carries an extension.
+void EmoteManager::loadImage(Emote* emote, const QByteArray& data) {
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    
+    QImageReader reader(&buffer);
+    emote->animated = reader.supportsAnimation() && reader.imageCount() != 1;
+    emote->pixmap = QPixmap::fromImage(reader.read());
+    if (emote->animated) {
+        emote->animationData = data;
+    }
+}
+
+// Decodes the frames on the decoder thread as QImages; they become pixmaps
+// back on the GUI thread. The token tells a finished decode whether its
+// emote is still the one it started for, since a released channel frees
+// its emotes while their decodes may still be running.
+void EmoteManager::decodeFrames(Emote* emote) {
+    if (decoding.contains(emote)) {
+        return;
+    }
+    quint64 token = ++nextDecode;
+    decoding.insert(emote, token);
+    
+    QByteArray data = emote->animationData;
+    decoder.start([this, emote, token, data]() {
+        QByteArray bytes = data;
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::ReadOnly);
+        
+        QImageReader reader(&buffer);
+        QList<QImage> images;
+        QList<int> ends;
+        int end = 0;
+        while (images.size() < MaxFrames) {
+            QImage image = reader.read();
+            if (image.isNull()) {
+                break;
+            }
+            int delay = reader.nextImageDelay();
+            end += delay > 10 ? delay : 100;
+            images.append(image);
+            ends.append(end);
+        }
+        
+        QMetaObject::invokeMethod(this, [this, emote, token, images, ends]() {
+            framesDecoded(emote, token, images, ends);
+        }, Qt::QueuedConnection);
+    });
 }
 
-bool EmoteManager::hasEmote(const QString& name) {
-    return emotes.contains(name);
+void EmoteManager::framesDecoded(Emote* emote, quint64 token, const QList<QImage>& images, const QList<int>& ends) {
+    auto it = decoding.find(emote);
+    if (it == decoding.end() || it.value() != token) {
+        return;
+    }
+    decoding.erase(it);
+    
+    emote->animationData.clear();
+    if (images.size() < 2) {
+        emote->animated = false;
+        return;
+    }
+    
+    emote->frames.reserve(images.size());
+    for (const QImage& image : images) {
+        emote->frames.append(QPixmap::fromImage(image));
+    }
+    emote->frameEnds = ends;
+}
+
+// Frame shown at time ms on the shared animation clock. Every occurrence of
+// an emote in every view shows the same frame; until its frames are
+// decoded an animated emote shows the first one.
+int EmoteManager::frameIndex(Emote* emote, qint64 time) {
+    if (!emote->animated) {
+        return 0;
+    }
+    if (emote->frames.isEmpty()) {
+        if (!emote->animationData.isEmpty()) {
+            decodeFrames(emote);
+        }
+        return 0;
+    }
+    
+    int position = int(time % emote->frameEnds.last());
+    auto it = std::upper_bound(emote->frameEnds.cbegin(), emote->frameEnds.cend(), position);
+    return int(qMin<qsizetype>(it - emote->frameEnds.cbegin(), emote->frames.size() - 1));
+}
+
+// Adds third-party emote ranges to msg.emotes. Tokens already covered by
+// a Twitch range from the emotes tag are not looked up again.
+void EmoteSet::resolve(ChatMessage& msg) const {
+    if (table.isEmpty()) {
+        return;
+    }
+    
+    const QString& text = msg.text;
+    qsizetype twitchCount = msg.emotes.size();
+    qsizetype next = 0;
+    int pos = 0;
+    while (pos < text.size()) {
+        int end = text.indexOf(' ', pos);
+        if (end < 0) {
+            end = text.size();
+        }
+        
+        if (end > pos) {
+            while (next < twitchCount && msg.emotes[next].end <= pos) {
+                next++;
+            }
+            bool covered = next < twitchCount && msg.emotes[next].start < end;
+            if (!covered && table.contains(QString::fromRawData(text.constData() + pos, end - pos))) {
+                msg.emotes.append({pos, end, QString()});
+            }
+        }
+        pos = end + 1;
+    }
+    
+    if (msg.emotes.size() > twitchCount && twitchCount > 0) {
+        std::sort(msg.emotes.begin(), msg.emotes.end(), [](const EmoteRange& a, const EmoteRange& b) {
+            return a.start < b.start;
+        });
+    }
+}
+
+// Takes ownership of emote. The first emote of a name wins within a layer;
+// a channel's own emote hides a global one of the same name in its table.
+void EmoteManager::addEmote(Emote* emote, const QString& channel) {
+    EmoteSet* set = layer(channel);
+    if (!set || set->own.contains(emote->name)) {
+        delete emote;
+        return;
+    }
+    
+    set->own.insert(emote->name, emote);
+    set->table.insert(emote->name, emote);
+    if (set == &global) {
+        for (EmoteSet* channelSet : std::as_const(channels)) {
+            if (!channelSet->own.contains(emote->name)) {
+                channelSet->table.insert(emote->name, emote);
+            }
+        }
+    }
+    emit emoteLoaded(channel.toLower(), emote->name);
 }
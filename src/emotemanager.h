@@ -4,18 +4,51 @@
 #include <QObject>
 #include <QPixmap>
 #include <QMap>
+#include <QHash>
 #include <QNetworkAccessManager>
-#include <QMovie>
+#include <QThreadPool>
+#include <QImage>
+#include "chatmessage.h"
 
 struct Emote {
     QString id;
     QString name;
     QString url;
     QPixmap pixmap;
-    QMovie* movie = nullptr;
     bool animated = false;
     int width = 28;
     int height = 28;
+    
+    // Animated emotes keep their encoded image until first shown, then
+    // a background decode replaces it with the frames and the cumulative
+    // time at which each one ends. pixmap stays the first frame.
+    QByteArray animationData;
+    QList<QPixmap> frames;
+    QList<int> frameEnds;
+};
+
+// One layer of emotes and the table names are resolved through. The global
+// set's table is just its own emotes; a channel set owns that channel's
+// Twitch, BTTV, FFZ and 7TV emotes, and its table also carries every global
+// emote it does not override, so a lookup is a single hash probe and a
+// channel never sees another channel's emotes.
+class EmoteSet {
+public:
+    EmoteSet() = default;
+    ~EmoteSet() { qDeleteAll(own); }
+    
+    Emote* find(const QString& name) const { return table.value(name, nullptr); }
+    bool contains(const QString& name) const { return table.contains(name); }
+    int size() const { return int(table.size()); }
+    void resolve(ChatMessage& msg) const;
+    
+private:
+    friend class EmoteManager;
+    Q_DISABLE_COPY(EmoteSet)
+    
+    QHash<QString, Emote*> own;
+    QHash<QString, Emote*> table;
+    int refs = 0;
 };
 
 class EmoteManager : public QObject {
@@ -25,19 +58,23 @@ public:
     static EmoteManager& instance();
     
     void loadTwitchGlobalEmotes(const QString& token);
-    void loadChannelEmotes(const QString& channelId, const QString& token);
-    void loadBTTVEmotes(const QString& channelId);
-    void loadFFZEmotes(const QString& channelId);
-    void load7TVEmotes(const QString& channelId);
+    void loadChannelEmotes(const QString& channel, const QString& channelId, const QString& token);
+    void loadBTTVEmotes(const QString& channel);
+    void loadFFZEmotes(const QString& channel);
+    void load7TVEmotes(const QString& channel);
+    
+    const EmoteSet& globalEmotes() const { return global; }
+    const EmoteSet* acquireChannel(const QString& channel);
+    void releaseChannel(const QString& channel);
     
-    Emote* getEmote(const QString& name);
-    bool hasEmote(const QString& name);
+    void addEmote(Emote* emote, const QString& channel = QString());
+    int frameIndex(Emote* emote, qint64 time);
     
-    void downloadEmote(const QString& name, const QString& url, bool animated);
+    void downloadEmote(const QString& channel, const QString& name, const QString& url, bool animated);
     QString getCachePath();
     
 signals:
-    void emoteLoaded(const QString& name);
+    void emoteLoaded(const QString& channel, const QString& name);
     void emotesUpdated();
     
 private slots:
@@ -48,10 +85,29 @@ private slots:
     void handle7TVResponse(QNetworkReply* reply);
     
 private:
+    static constexpr int MaxFrames = 512;
+    
+    struct PendingEmote {
+        QString channel;
+        QString name;
+    };
+    
     EmoteManager();
+    void loadImage(Emote* emote, const QByteArray& data);
+    void decodeFrames(Emote* emote);
+    void framesDecoded(Emote* emote, quint64 token, const QList<QImage>& images, const QList<int>& ends);
+    EmoteSet* layer(const QString& channel);
+    QString cacheFile(const QString& url);
     QNetworkAccessManager* nam;
-    QMap<QString, Emote*> emotes;
-    QMap<QNetworkReply*, QString> pendingDownloads;
+    EmoteSet global;
+    QHash<QString, EmoteSet*> channels;
+    QHash<QNetworkReply*, PendingEmote> pendingDownloads;
+    QHash<Emote*, quint64> decoding;
+    quint64 nextDecode = 0;
+    
+    // Declared last so it is destroyed first, waiting for running decodes
+    // while the rest of the manager is still intact.
+    QThreadPool decoder;
 };
 
 #endif
@@ -65,6 +65,10 @@ FilterWidget::FilterWidget(QWidget* parent) : QWidget(parent) {
     keywordLayout->addWidget(keywordsList);
     keywordLayout->addLayout(keywordBtnLayout);
     
+    wholeWordsCheck = new QCheckBox("Match whole words only", this);
+    wholeWordsCheck->setChecked(Settings::instance().highlightWholeWords);
+    keywordLayout->addWidget(wholeWordsCheck);
+    
     for (const QString& keyword : Settings::instance().highlightKeywords) {
         keywordsList->addItem(keyword);
     }
@@ -132,6 +136,7 @@ void FilterWidget::saveFilters() {
     for (int i = 0; i < keywordsList->count(); ++i) {
         Settings::instance().highlightKeywords.append(keywordsList->item(i)->text());
     }
+    Settings::instance().highlightWholeWords = wholeWordsCheck->isChecked();
     
     Settings::instance().save();
 }
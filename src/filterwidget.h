@@ -5,6 +5,7 @@
 #include <QListWidget>
 #include <QLineEdit>
 #include <QPushButton>
+#include <QCheckBox>
 #include <QVBoxLayout>
 
 class FilterWidget : public QWidget {
@@ -29,6 +30,7 @@ private:
     QLineEdit* highlightedUserInput;
     QListWidget* keywordsList;
     QLineEdit* keywordInput;
+    QCheckBox* wholeWordsCheck;
 };
 
 #endif
@@ -0,0 +1,124 @@
+#include "highlightmatcher.h"
+
+HighlightMatcher::HighlightMatcher(const QStringList& users, const QStringList& keywords, bool wholeWords)
+    : wholeWords(wholeWords) {
+    for (const QString& user : users) {
+        QString login = user.trimmed().toLower();
+        if (!login.isEmpty()) {
+            this->users.insert(login);
+        }
+    }
+    
+    states.append(State());
+    for (const QString& keyword : keywords) {
+        addPattern(keyword.trimmed());
+    }
+    link();
+}
+
+void HighlightMatcher::addPattern(const QString& pattern) {
+    if (pattern.isEmpty()) {
+        return;
+    }
+    
+    int state = 0;
+    for (QChar ch : pattern) {
+        quint64 key = edge(state, fold(ch));
+        auto it = transitions.constFind(key);
+        if (it != transitions.constEnd()) {
+            state = it.value();
+            continue;
+        }
+        
+        State child;
+        child.depth = states[state].depth + 1;
+        states.append(child);
+        transitions.insert(key, int(states.size()) - 1);
+        state = int(states.size()) - 1;
+    }
+    
+    if (!states[state].terminal) {
+        states[state].terminal = true;
+        patterns++;
+    }
+}
+
+// Breadth-first over the trie: each state's failure link is the longest
+// proper suffix that is also a trie path, and its output link the nearest
+// terminal state along the failure chain.
+void HighlightMatcher::link() {
+    QHash<int, QList<QPair<char16_t, int>>> children;
+    for (auto it = transitions.constBegin(); it != transitions.constEnd(); ++it) {
+        children[int(it.key() >> 16)].append({char16_t(it.key() & 0xffff), it.value()});
+    }
+    
+    QList<int> queue;
+    for (const QPair<char16_t, int>& child : children.value(0)) {
+        queue.append(child.second);
+    }
+    
+    for (qsizetype head = 0; head < queue.size(); ++head) {
+        int state = queue[head];
+        for (const QPair<char16_t, int>& child : children.value(state)) {
+            int fail = states[state].fail;
+            int target = 0;
+            for (;;) {
+                auto it = transitions.constFind(edge(fail, child.first));
+                if (it != transitions.constEnd()) {
+                    target = it.value();
+                    break;
+                }
+                if (fail == 0) {
+                    break;
+                }
+                fail = states[fail].fail;
+            }
+            
+            State& node = states[child.second];
+            node.fail = target;
+            node.output = states[target].terminal ? target : states[target].output;
+            queue.append(child.second);
+        }
+    }
+}
+
+int HighlightMatcher::next(int state, char16_t ch) const {
+    for (;;) {
+        auto it = transitions.constFind(edge(state, ch));
+        if (it != transitions.constEnd()) {
+            return it.value();
+        }
+        if (state == 0) {
+            return 0;
+        }
+        state = states[state].fail;
+    }
+}
+
+bool HighlightMatcher::matchesText(QStringView text) const {
+    if (patterns == 0) {
+        return false;
+    }
+    
+    int state = 0;
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        state = next(state, fold(text[i]));
+        
+        int match = states[state].terminal ? state : states[state].output;
+        if (match <= 0) {
+            continue;
+        }
+        if (!wholeWords) {
+            return true;
+        }
+        
+        bool endsWord = i + 1 == text.size() || !isWordChar(text[i + 1]);
+        for (; match > 0; match = states[match].output) {
+            qsizetype start = i - states[match].depth + 1;
+            if (endsWord && (start == 0 || !isWordChar(text[start - 1]))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,46 @@
+#ifndef HIGHLIGHTMATCHER_H
+#define HIGHLIGHTMATCHER_H
+
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QHash>
+#include <QList>
+
+// Highlight filters compiled for the per-message path: highlighted users
+// go into a hash set and keywords into one Aho-Corasick automaton over
+// case-folded UTF-16, so a message is classified in a single pass over
+// its text however many keywords there are. A matcher never changes once
+// built; Settings compiles a new one into every snapshot it publishes.
+class HighlightMatcher {
+public:
+    HighlightMatcher(const QStringList& users, const QStringList& keywords, bool wholeWords);
+    
+    bool matchesUser(const QString& login) const { return users.contains(login); }
+    bool matchesText(QStringView text) const;
+    int keywordCount() const { return patterns; }
+    
+private:
+    struct State {
+        int fail = 0;
+        int output = -1;
+        int depth = 0;
+        bool terminal = false;
+    };
+    
+    QSet<QString> users;
+    QList<State> states;
+    QHash<quint64, int> transitions;
+    bool wholeWords;
+    int patterns = 0;
+    
+    int next(int state, char16_t ch) const;
+    void addPattern(const QString& pattern);
+    void link();
+    
+    static quint64 edge(int state, char16_t ch) { return (quint64(state) << 16) | ch; }
+    static char16_t fold(QChar ch) { return char16_t(QChar::toCaseFolded(ch.unicode())); }
+    static bool isWordChar(QChar ch) { return ch.isLetterOrNumber() || ch == u'_'; }
+};
+
+#endif
@@ -0,0 +1,392 @@
+#include "ircconnection.h"
+#include "irctags.h"
+#include "latency.h"
+#include <QRandomGenerator>
+#include <algorithm>
+
+IrcConnection::IrcConnection(QObject* parent)
+    : QObject(parent), eventQueue(QueueCapacity) {
+    socket = new QTcpSocket(this);
+    pingTimer = new QTimer(this);
+    pongTimer = new QTimer(this);
+    reconnectTimer = new QTimer(this);
+    connectTimer = new QTimer(this);
+    
+    connect(socket, &QTcpSocket::connected, this, &IrcConnection::onConnected);
+    connect(socket, &QTcpSocket::disconnected, this, &IrcConnection::onDisconnected);
+    connect(socket, &QTcpSocket::readyRead, this, &IrcConnection::onReadyRead);
+    connect(socket, &QTcpSocket::errorOccurred, this, &IrcConnection::onError);
+    
+    connect(pingTimer, &QTimer::timeout, this, &IrcConnection::handlePing);
+    pingTimer->setInterval(PingInterval);
+    
+    pongTimer->setSingleShot(true);
+    pongTimer->setInterval(PongTimeout);
+    connect(pongTimer, &QTimer::timeout, this, &IrcConnection::onPongTimeout);
+    
+    reconnectTimer->setSingleShot(true);
+    connect(reconnectTimer, &QTimer::timeout, this, &IrcConnection::reconnect);
+    
+    connectTimer->setSingleShot(true);
+    connectTimer->setInterval(ConnectTimeout);
+    connect(connectTimer, &QTimer::timeout, this, &IrcConnection::onConnectTimeout);
+}
+
+void IrcConnection::open(const QString& token, const QString& username, const QString& host, quint16 port) {
+    currentToken = token;
+    currentUsername = username;
+    serverHost = host;
+    serverPort = port;
+    attempts = 0;
+    outageClock.invalidate();
+    reconnectTimer->stop();
+    
+    state = Closed;
+    if (socket->state() != QTcpSocket::UnconnectedState) {
+        socket->abort();
+    }
+    reconnect();
+}
+
+void IrcConnection::close() {
+    state = Closed;
+    reconnectTimer->stop();
+    connectTimer->stop();
+    pongTimer->stop();
+    if (socket->state() != QTcpSocket::UnconnectedState) {
+        socket->disconnectFromHost();
+    }
+}
+
+// The OS may take minutes to give up on a connect that gets no answer, so
+// a connect that has not completed within ConnectTimeout is retried.
+void IrcConnection::reconnect() {
+    state = Connecting;
+    connectTimer->start();
+    socket->connectToHost(serverHost, serverPort);
+}
+
+void IrcConnection::scheduleReconnect(int delayMs) {
+    if (state == Closed || reconnectTimer->isActive()) {
+        return;
+    }
+    
+    if (!outageClock.isValid()) {
+        outageClock.start();
+    }
+    
+    if (delayMs < 0) {
+        int ceiling = ReconnectMaxDelay;
+        if (attempts < 16) {
+            ceiling = qMin(ReconnectMaxDelay, ReconnectBaseDelay << attempts);
+        }
+        delayMs = ceiling / 2 + int(QRandomGenerator::global()->bounded(ceiling / 2 + 1));
+    }
+    attempts++;
+    
+    state = Backoff;
+    connectTimer->stop();
+    pingTimer->stop();
+    pongTimer->stop();
+    emit reconnecting(attempts, delayMs);
+    reconnectTimer->start(delayMs);
+}
+
+void IrcConnection::onConnected() {
+    connectTimer->stop();
+    readBuffer.clear();
+    
+    QByteArray login = "CAP REQ :twitch.tv/tags twitch.tv/commands\r\n";
+    login += "PASS oauth:" + currentToken.toUtf8() + "\r\n";
+    login += "NICK " + currentUsername.toUtf8() + "\r\n";
+    socket->write(login);
+    
+    state = Connected;
+    pingTimer->start();
+    emit connected();
+}
+
+void IrcConnection::onDisconnected() {
+    pingTimer->stop();
+    pongTimer->stop();
+    emit disconnected();
+    scheduleReconnect();
+}
+
+void IrcConnection::onError(QAbstractSocket::SocketError error) {
+    emit connectionError(socket->errorString());
+    
+    // A failed connect never emits disconnected(), so retry from here.
+    if (socket->state() == QTcpSocket::UnconnectedState) {
+        scheduleReconnect();
+    }
+}
+
+void IrcConnection::handlePing() {
+    socket->write("PING :tmi.twitch.tv\r\n");
+    if (!pongTimer->isActive()) {
+        pongTimer->start();
+    }
+}
+
+void IrcConnection::onPongTimeout() {
+    emit connectionError("No PONG from server, reconnecting");
+    socket->abort();
+    if (state != Backoff) {
+        scheduleReconnect();
+    }
+}
+
+void IrcConnection::onConnectTimeout() {
+    if (state != Connecting) {
+        return;
+    }
+    emit connectionError("Connection timed out, reconnecting");
+    socket->abort();
+    scheduleReconnect();
+}
+
+void IrcConnection::addChannel(const QString& channel, int channelId) {
+    channelIds.insert(channel.mid(1).toUtf8(), channelId);
+}
+
+void IrcConnection::part(const QString& channel) {
+    channelIds.remove(channel.mid(1).toUtf8());
+    if (socket->state() == QTcpSocket::ConnectedState) {
+        socket->write(QString("PART %1\r\n").arg(channel).toUtf8());
+    }
+}
+
+void IrcConnection::sendLine(const QByteArray& line) {
+    socket->write(line);
+}
+
+void IrcConnection::route(ChatEvent& event, QByteArrayView channel) const {
+    event.channelId = channelIds.value(QByteArray::fromRawData(channel.data(), channel.size()), -1);
+    if (event.channelId < 0) {
+        event.channel = QString::fromUtf8(channel);
+    }
+}
+
+void IrcConnection::post(ChatEvent::Type type, QByteArrayView channel, const QString& text) {
+    ChatEvent event;
+    event.type = type;
+    route(event, channel);
+    event.text = text;
+    eventQueue.push(std::move(event));
+}
+
+void IrcConnection::onReadyRead() {
+    readBuffer.append(socket->readAll());
+    qint64 readAt = Latency::now();
+    
+    qsizetype start = 0;
+    while (true) {
+        qsizetype newline = readBuffer.indexOf('\n', start);
+        if (newline < 0) {
+            break;
+        }
+        
+        QByteArrayView line(readBuffer.constData() + start, newline - start);
+        start = newline + 1;
+        
+        if (line.endsWith('\r')) {
+            line.chop(1);
+        }
+        if (line.isEmpty()) {
+            continue;
+        }
+        
+        pongTimer->stop();
+        
+        if (rawEnabled.load(std::memory_order_relaxed)) {
+            post(ChatEvent::Raw, QByteArrayView(), QString::fromUtf8(line));
+        }
+        
+        parseMessage(line, readAt);
+        if (state != Connected) {
+            readBuffer.clear();
+            return;
+        }
+    }
+    
+    readBuffer.remove(0, start);
+}
+
+void IrcConnection::parseMessage(QByteArrayView line, qint64 readAt) {
+    IrcMessage irc;
+    if (!irc.parse(line)) {
+        return;
+    }
+    
+    if (irc.command == "PRIVMSG") {
+        QByteArrayView channel = irc.channel();
+        if (!channel.isEmpty()) {
+            ChatEvent event;
+            event.type = ChatEvent::Message;
+            route(event, channel);
+            event.message = parsePrivMsg(irc);
+            event.message.readAt = readAt;
+            event.message.parsedAt = Latency::now();
+            eventQueue.push(std::move(event));
+        }
+    } else if (irc.command == "USERNOTICE") {
+        if (irc.hasTrailing) {
+            post(ChatEvent::UserNotice, irc.channel(), QString::fromUtf8(irc.trailing));
+        } else {
+            IrcTags tags(irc.tags);
+            post(ChatEvent::UserNotice, irc.channel(), tags.value(IrcTags::SystemMsg));
+        }
+    } else if (irc.command == "CLEARMSG") {
+        IrcTags tags(irc.tags);
+        QString targetId = tags.value(IrcTags::TargetMsgId);
+        if (!targetId.isEmpty()) {
+            post(ChatEvent::MessageDeleted, irc.channel(), targetId);
+        }
+    } else if (irc.command == "CLEARCHAT") {
+        IrcTags tags(irc.tags);
+        post(ChatEvent::ChatCleared, irc.channel(), tags.value(IrcTags::TargetUserId));
+    } else if (irc.command == "ROOMSTATE") {
+        IrcTags tags(irc.tags);
+        QString roomId = tags.value(IrcTags::RoomId);
+        if (!roomId.isEmpty()) {
+            post(ChatEvent::RoomState, irc.channel(), roomId);
+        }
+    } else if (irc.command == "USERSTATE") {
+        IrcTags tags(irc.tags);
+        bool moderator = tags.raw(IrcTags::Mod) == "1" || tags.raw(IrcTags::Badges).contains("broadcaster/");
+        post(ChatEvent::UserState, irc.channel(), moderator ? "1" : "0");
+    } else if (irc.command == "JOIN") {
+        if (QString::fromUtf8(irc.nick()).compare(currentUsername, Qt::CaseInsensitive) == 0) {
+            post(ChatEvent::Joined, irc.channel(), QString());
+        }
+    } else if (irc.command == "PING") {
+        QByteArray pong("PONG :");
+        pong.append(irc.hasTrailing ? irc.trailing : irc.param(0));
+        pong.append("\r\n");
+        socket->write(pong);
+    } else if (irc.command == "001") {
+        attempts = 0;
+        if (outageClock.isValid()) {
+            emit reconnected(outageClock.elapsed());
+            outageClock.invalidate();
+        }
+    } else if (irc.command == "RECONNECT") {
+        emit reconnectRequested();
+        scheduleReconnect(0);
+        socket->abort();
+    }
+}
+
+// Decodes "25:0-4,12-16/1902:6-10". Twitch counts code points, so offsets
+// are remapped when the text contains surrogate pairs.
+QList<EmoteRange> IrcConnection::parseEmotes(QByteArrayView tag, const QString& text) {
+    QList<EmoteRange> ranges;
+    if (tag.isEmpty()) {
+        return ranges;
+    }
+    
+    QList<int> utf16Offsets;
+    for (int i = 0; i < text.size(); ++i) {
+        if (text.at(i).isHighSurrogate()) {
+            utf16Offsets.reserve(text.size() + 1);
+            for (int j = 0; j < text.size(); ++j) {
+                utf16Offsets.append(j);
+                if (text.at(j).isHighSurrogate() && j + 1 < text.size()) {
+                    ++j;
+                }
+            }
+            utf16Offsets.append(text.size());
+            break;
+        }
+    }
+    auto parseNumber = [](QByteArrayView digits) -> qint64 {
+        if (digits.isEmpty() || digits.size() > 9) {
+            return -1;
+        }
+        qint64 value = 0;
+        for (char c : digits) {
+            if (c < '0' || c > '9') {
+                return -1;
+            }
+            value = value * 10 + (c - '0');
+        }
+        return value;
+    };
+    auto toUtf16 = [&utf16Offsets](qint64 codePoint) -> int {
+        if (utf16Offsets.isEmpty()) {
+            return int(codePoint);
+        }
+        return utf16Offsets.value(int(codePoint), -1);
+    };
+    
+    while (!tag.isEmpty()) {
+        qsizetype slash = tag.indexOf('/');
+        QByteArrayView emote = slash < 0 ? tag : tag.first(slash);
+        tag = slash < 0 ? QByteArrayView() : tag.sliced(slash + 1);
+        
+        qsizetype colon = emote.indexOf(':');
+        if (colon <= 0) {
+            continue;
+        }
+        QString id = QString::fromLatin1(emote.first(colon));
+        QByteArrayView positions = emote.sliced(colon + 1);
+        
+        while (!positions.isEmpty()) {
+            qsizetype comma = positions.indexOf(',');
+            QByteArrayView range = comma < 0 ? positions : positions.first(comma);
+            positions = comma < 0 ? QByteArrayView() : positions.sliced(comma + 1);
+            
+            qsizetype dash = range.indexOf('-');
+            if (dash <= 0) {
+                continue;
+            }
+            qint64 first = parseNumber(range.first(dash));
+            qint64 last = parseNumber(range.sliced(dash + 1));
+            if (first < 0 || last < first) {
+                continue;
+            }
+            int start = toUtf16(first);
+            int end = toUtf16(last + 1);
+            if (start >= 0 && end > start && end <= text.size()) {
+                ranges.append({start, end, id});
+            }
+        }
+    }
+    
+    std::sort(ranges.begin(), ranges.end(), [](const EmoteRange& a, const EmoteRange& b) {
+        return a.start < b.start;
+    });
+    return ranges;
+}
+
+ChatMessage IrcConnection::parsePrivMsg(const IrcMessage& irc) {
+    ChatMessage msg;
+    
+    IrcTags tags(irc.tags);
+    msg.user = UserTable::instance().intern(tags.raw(IrcTags::UserId), irc.nick(), tags.raw(IrcTags::DisplayName),
+                                            tags.raw(IrcTags::Color), tags.raw(IrcTags::Badges));
+    
+    msg.serverTime = tags.toInt(IrcTags::TmiSentTs);
+    if (msg.serverTime > 0) {
+        msg.timestamp = QDateTime::fromMSecsSinceEpoch(msg.serverTime);
+    } else {
+        msg.timestamp = QDateTime::currentDateTime();
+    }
+    
+    QByteArrayView text = irc.trailing;
+    if (text.startsWith("\x01" "ACTION")) {
+        msg.isAction = true;
+        text = text.sliced(qMin<qsizetype>(8, text.size()));
+        if (text.endsWith('\x01')) {
+            text.chop(1);
+        }
+    }
+    msg.text = QString::fromUtf8(text);
+    
+    msg.id = tags.value(IrcTags::Id);
+    msg.bits = static_cast<int>(tags.toInt(IrcTags::Bits));
+    msg.emotes = parseEmotes(tags.raw(IrcTags::Emotes), msg.text);
+    
+    return msg;
+}
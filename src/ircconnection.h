@@ -0,0 +1,99 @@
+#ifndef IRCCONNECTION_H
+#define IRCCONNECTION_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QStringList>
+#include <QHash>
+#include <QElapsedTimer>
+#include <atomic>
+#include "chatevent.h"
+#include "ircparser.h"
+#include "spscqueue.h"
+
+// One IRC socket plus its parser. It may live on a worker thread; parsed
+// events are handed to the GUI through events(), and every public slot must
+// be invoked on the connection's own thread. JOINs are not sent from here:
+// TwitchChat's JoinScheduler budgets them and its SendQueue writes them,
+// together with outgoing chat lines, via sendLine().
+//
+// Once opened, the connection keeps itself alive until close(): lost
+// sockets, failed connects, unanswered PINGs and server RECONNECTs all lead
+// back to connectToHost() after a jittered exponential backoff.
+class IrcConnection : public QObject {
+    Q_OBJECT
+    
+public:
+    static constexpr int QueueCapacity = 8192;
+    static constexpr int PingInterval = 60000;
+    static constexpr int PongTimeout = 10000;
+    static constexpr int ConnectTimeout = 15000;
+    static constexpr int ReconnectBaseDelay = 1000;
+    static constexpr int ReconnectMaxDelay = 60000;
+    
+    enum State {
+        Closed,
+        Connecting,
+        Connected,
+        Backoff
+    };
+    
+    explicit IrcConnection(QObject* parent = nullptr);
+    
+    SpscQueue<ChatEvent>& events() { return eventQueue; }
+    void setRawEnabled(bool enabled) { rawEnabled.store(enabled, std::memory_order_relaxed); }
+    
+    static ChatMessage parsePrivMsg(const IrcMessage& irc);
+    static QList<EmoteRange> parseEmotes(QByteArrayView tag, const QString& text);
+    
+public slots:
+    void open(const QString& token, const QString& username, const QString& host, quint16 port);
+    void close();
+    void addChannel(const QString& channel, int channelId);
+    void part(const QString& channel);
+    void sendLine(const QByteArray& line);
+    
+signals:
+    void connected();
+    void disconnected();
+    void connectionError(const QString& error);
+    void reconnectRequested();
+    void reconnecting(int attempt, int delayMs);
+    void reconnected(qint64 outageMs);
+    
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onReadyRead();
+    void onError(QAbstractSocket::SocketError error);
+    void handlePing();
+    void onPongTimeout();
+    void onConnectTimeout();
+    void reconnect();
+    
+private:
+    QTcpSocket* socket;
+    QTimer* pingTimer;
+    QTimer* pongTimer;
+    QTimer* reconnectTimer;
+    QTimer* connectTimer;
+    State state = Closed;
+    int attempts = 0;
+    QElapsedTimer outageClock;
+    QString currentToken;
+    QString currentUsername;
+    QString serverHost;
+    quint16 serverPort = 6667;
+    QHash<QByteArray, int> channelIds;
+    QByteArray readBuffer;
+    SpscQueue<ChatEvent> eventQueue;
+    std::atomic<bool> rawEnabled{false};
+    
+    void scheduleReconnect(int delayMs = -1);
+    void parseMessage(QByteArrayView line, qint64 readAt);
+    void route(ChatEvent& event, QByteArrayView channel) const;
+    void post(ChatEvent::Type type, QByteArrayView channel, const QString& text);
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "ircparser.h"
+
+static const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && *p == ' ') {
+        ++p;
+    }
+    return p;
+}
+
+static const char* findSpace(const char* p, const char* end) {
+    while (p < end && *p != ' ') {
+        ++p;
+    }
+    return p;
+}
+
+bool IrcMessage::parse(QByteArrayView line) {
+    *this = IrcMessage();
+    
+    const char* p = line.data();
+    const char* end = p + line.size();
+    
+    while (end > p && (end[-1] == '\r' || end[-1] == '\n')) {
+        --end;
+    }
+    
+    if (p < end && *p == '@') {
+        const char* tagsEnd = findSpace(p, end);
+        tags = QByteArrayView(p + 1, tagsEnd - p - 1);
+        p = skipSpaces(tagsEnd, end);
+    }
+    
+    if (p < end && *p == ':') {
+        const char* prefixEnd = findSpace(p, end);
+        prefix = QByteArrayView(p + 1, prefixEnd - p - 1);
+        p = skipSpaces(prefixEnd, end);
+    }
+    
+    const char* commandEnd = findSpace(p, end);
+    command = QByteArrayView(p, commandEnd - p);
+    if (command.isEmpty()) {
+        return false;
+    }
+    p = skipSpaces(commandEnd, end);
+    
+    while (p < end) {
+        if (*p == ':') {
+            trailing = QByteArrayView(p + 1, end - p - 1);
+            hasTrailing = true;
+            break;
+        }
+        
+        const char* paramEnd = findSpace(p, end);
+        if (paramCount < MaxParams) {
+            params[paramCount++] = QByteArrayView(p, paramEnd - p);
+        }
+        p = skipSpaces(paramEnd, end);
+    }
+    
+    return true;
+}
+
+QByteArrayView IrcMessage::nick() const {
+    const char* p = prefix.data();
+    const char* end = p + prefix.size();
+    const char* bang = p;
+    while (bang < end && *bang != '!') {
+        ++bang;
+    }
+    return QByteArrayView(p, bang - p);
+}
+
+QByteArrayView IrcMessage::channel() const {
+    if (paramCount == 0 || !params[0].startsWith('#')) {
+        return QByteArrayView();
+    }
+    return params[0].sliced(1);
+}
+
+QByteArrayView IrcMessage::param(int index) const {
+    if (index < 0 || index >= paramCount) {
+        return QByteArrayView();
+    }
+    return params[index];
+}
@@ -0,0 +1,26 @@
+#ifndef IRCPARSER_H
+#define IRCPARSER_H
+
+#include <QByteArrayView>
+
+// Views into a single raw IRC line. Nothing is copied; the views stay valid
+// only as long as the buffer the line was parsed from.
+struct IrcMessage {
+    static constexpr int MaxParams = 15;
+    
+    QByteArrayView tags;
+    QByteArrayView prefix;
+    QByteArrayView command;
+    QByteArrayView params[MaxParams];
+    int paramCount = 0;
+    QByteArrayView trailing;
+    bool hasTrailing = false;
+    
+    bool parse(QByteArrayView line);
+    
+    QByteArrayView nick() const;
+    QByteArrayView channel() const;
+    QByteArrayView param(int index) const;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "irctags.h"
+#include <cstring>
+
+struct KnownTag {
+    const char* name;
+    IrcTags::Key key;
+};
+
+static const KnownTag knownTags[] = {
+    {"badge-info", IrcTags::BadgeInfo},
+    {"badges", IrcTags::Badges},
+    {"ban-duration", IrcTags::BanDuration},
+    {"bits", IrcTags::Bits},
+    {"color", IrcTags::Color},
+    {"display-name", IrcTags::DisplayName},
+    {"emotes", IrcTags::Emotes},
+    {"id", IrcTags::Id},
+    {"login", IrcTags::Login},
+    {"mod", IrcTags::Mod},
+    {"msg-id", IrcTags::MsgId},
+    {"room-id", IrcTags::RoomId},
+    {"system-msg", IrcTags::SystemMsg},
+    {"target-msg-id", IrcTags::TargetMsgId},
+    {"target-user-id", IrcTags::TargetUserId},
+    {"tmi-sent-ts", IrcTags::TmiSentTs},
+    {"user-id", IrcTags::UserId},
+};
+
+IrcTags::IrcTags() {
+    std::memset(keySlots, -1, sizeof(keySlots));
+}
+
+IrcTags::IrcTags(QByteArrayView tags) {
+    parse(tags);
+}
+
+void IrcTags::parse(QByteArrayView tags) {
+    count = 0;
+    std::memset(keySlots, -1, sizeof(keySlots));
+    
+    const char* p = tags.data();
+    const char* end = p + tags.size();
+    
+    while (p < end && count < InlineCapacity) {
+        const char* pairEnd = static_cast<const char*>(std::memchr(p, ';', end - p));
+        if (!pairEnd) {
+            pairEnd = end;
+        }
+        
+        const char* eq = static_cast<const char*>(std::memchr(p, '=', pairEnd - p));
+        const char* nameEnd = eq ? eq : pairEnd;
+        
+        if (nameEnd > p) {
+            Entry& entry = entries[count];
+            entry.name = QByteArrayView(p, nameEnd - p);
+            entry.value = eq ? QByteArrayView(eq + 1, pairEnd - eq - 1) : QByteArrayView();
+            
+            Key key = intern(entry.name);
+            if (key != Unknown) {
+                keySlots[key] = static_cast<qint8>(count);
+            }
+            ++count;
+        }
+        
+        p = pairEnd + 1;
+    }
+}
+
+IrcTags::Key IrcTags::intern(QByteArrayView name) {
+    if (name.isEmpty()) {
+        return Unknown;
+    }
+    
+    for (const KnownTag& tag : knownTags) {
+        if (tag.name[0] == name[0] && name == QByteArrayView(tag.name)) {
+            return tag.key;
+        }
+    }
+    return Unknown;
+}
+
+QByteArrayView IrcTags::raw(Key key) const {
+    int slot = keySlots[key];
+    return slot >= 0 ? entries[slot].value : QByteArrayView();
+}
+
+QByteArrayView IrcTags::raw(QByteArrayView name) const {
+    for (int i = 0; i < count; ++i) {
+        if (entries[i].name == name) {
+            return entries[i].value;
+        }
+    }
+    return QByteArrayView();
+}
+
+QString IrcTags::value(Key key, const QString& defaultValue) const {
+    QByteArrayView v = raw(key);
+    if (v.isEmpty()) {
+        return defaultValue;
+    }
+    return unescape(v);
+}
+
+qint64 IrcTags::toInt(Key key, qint64 defaultValue) const {
+    QByteArrayView v = raw(key);
+    if (v.isEmpty()) {
+        return defaultValue;
+    }
+    
+    qint64 result = 0;
+    for (char c : v) {
+        if (c < '0' || c > '9') {
+            return defaultValue;
+        }
+        result = result * 10 + (c - '0');
+    }
+    return result;
+}
+
+QString IrcTags::unescape(QByteArrayView value) {
+    if (value.isEmpty()) {
+        return QString();
+    }
+    
+    if (!std::memchr(value.data(), '\\', value.size())) {
+        return QString::fromUtf8(value);
+    }
+    
+    QByteArray decoded;
+    decoded.reserve(value.size());
+    
+    for (qsizetype i = 0; i < value.size(); ++i) {
+        char c = value[i];
+        if (c != '\\') {
+            decoded.append(c);
+            continue;
+        }
+        
+        if (++i >= value.size()) {
+            break;
+        }
+        
+        switch (value[i]) {
+        case ':': decoded.append(';'); break;
+        case 's': decoded.append(' '); break;
+        case '\\': decoded.append('\\'); break;
+        case 'r': decoded.append('\r'); break;
+        case 'n': decoded.append('\n'); break;
+        default: decoded.append(value[i]); break;
+        }
+    }
+    
+    return QString::fromUtf8(decoded);
+}
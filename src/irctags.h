@@ -0,0 +1,62 @@
+#ifndef IRCTAGS_H
+#define IRCTAGS_H
+
+#include <QByteArrayView>
+#include <QString>
+
+// Flat view over an IRCv3 tag string. Keys the client reads are interned to
+// an enum so a lookup is one array index; values stay raw views into the line
+// and are only unescaped when asked for as a QString.
+class IrcTags {
+public:
+    enum Key : quint8 {
+        Unknown,
+        BadgeInfo,
+        Badges,
+        BanDuration,
+        Bits,
+        Color,
+        DisplayName,
+        Emotes,
+        Id,
+        Login,
+        Mod,
+        MsgId,
+        RoomId,
+        SystemMsg,
+        TargetMsgId,
+        TargetUserId,
+        TmiSentTs,
+        UserId,
+        KeyCount
+    };
+    
+    static constexpr int InlineCapacity = 32;
+    
+    IrcTags();
+    explicit IrcTags(QByteArrayView tags);
+    
+    void parse(QByteArrayView tags);
+    
+    int size() const { return count; }
+    bool contains(Key key) const { return keySlots[key] >= 0; }
+    QByteArrayView raw(Key key) const;
+    QByteArrayView raw(QByteArrayView name) const;
+    QString value(Key key, const QString& defaultValue = QString()) const;
+    qint64 toInt(Key key, qint64 defaultValue = 0) const;
+    
+    static Key intern(QByteArrayView name);
+    static QString unescape(QByteArrayView value);
+    
+private:
+    struct Entry {
+        QByteArrayView name;
+        QByteArrayView value;
+    };
+    
+    Entry entries[InlineCapacity];
+    qint8 keySlots[KeyCount];
+    int count = 0;
+};
+
+#endif
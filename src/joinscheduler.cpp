@@ -0,0 +1,121 @@
+#include "joinscheduler.h"
+#include <QMap>
+
+JoinScheduler::JoinScheduler(QObject* parent) : QObject(parent), bucket(20, 10000) {
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    connect(flushTimer, &QTimer::timeout, this, &JoinScheduler::flush);
+    clock.start();
+}
+
+void JoinScheduler::setBudget(int joins, int periodMs) {
+    bucket.configure(joins, periodMs);
+}
+
+void JoinScheduler::enqueue(int connection, const QString& channel) {
+    if (inflight.contains(channel)) {
+        return;
+    }
+    for (const PendingJoin& join : pending) {
+        if (join.channel == channel) {
+            return;
+        }
+    }
+    
+    if (sessionStart < 0) {
+        sessionStart = clock.elapsed();
+        sessionJoins = 0;
+    }
+    
+    pending.append({connection, channel, clock.elapsed()});
+    schedule(0);
+}
+
+void JoinScheduler::cancel(const QString& channel) {
+    inflight.remove(channel);
+    pending.removeIf([&channel](const PendingJoin& join) {
+        return join.channel == channel;
+    });
+    finishSessionIfIdle();
+}
+
+void JoinScheduler::cancelConnection(int connection) {
+    pending.removeIf([connection](const PendingJoin& join) {
+        return join.connection == connection;
+    });
+    for (auto it = inflight.begin(); it != inflight.end();) {
+        if (it->connection == connection) {
+            it = inflight.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    finishSessionIfIdle();
+}
+
+void JoinScheduler::confirm(const QString& channel) {
+    auto it = inflight.find(channel);
+    if (it == inflight.end()) {
+        return;
+    }
+    
+    qint64 waited = clock.elapsed() - it->queuedAt;
+    inflight.erase(it);
+    sessionJoins++;
+    
+    emit channelJoined(channel, waited);
+    finishSessionIfIdle();
+}
+
+void JoinScheduler::schedule(qint64 delayMs) {
+    if (flushTimer->isActive() && flushTimer->remainingTime() <= delayMs) {
+        return;
+    }
+    flushTimer->start(int(delayMs));
+}
+
+void JoinScheduler::flush() {
+    QMap<int, QByteArray> lines;
+    
+    while (!pending.isEmpty() && bucket.tryTake()) {
+        PendingJoin join = pending.takeFirst();
+        QByteArray name = join.channel.toUtf8();
+        QByteArray& line = lines[join.connection];
+        
+        if (!line.isEmpty() && line.size() + name.size() + 3 > MaxLineLength) {
+            emit sendLine(join.connection, line + "\r\n");
+            line.clear();
+        }
+        
+        if (line.isEmpty()) {
+            line = "JOIN " + name;
+        } else {
+            line += "," + name;
+        }
+        
+        inflight.insert(join.channel, {join.connection, join.queuedAt});
+    }
+    
+    for (auto it = lines.constBegin(); it != lines.constEnd(); ++it) {
+        emit sendLine(it.key(), it.value() + "\r\n");
+    }
+    
+    if (!pending.isEmpty()) {
+        schedule(bucket.msUntilAvailable());
+    }
+}
+
+void JoinScheduler::finishSessionIfIdle() {
+    if (sessionStart < 0 || !pending.isEmpty() || !inflight.isEmpty()) {
+        return;
+    }
+    
+    qint64 elapsed = clock.elapsed() - sessionStart;
+    int joined = sessionJoins;
+    sessionStart = -1;
+    sessionJoins = 0;
+    
+    if (joined > 0) {
+        emit allJoined(joined, elapsed);
+    }
+}
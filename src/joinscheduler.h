@@ -0,0 +1,63 @@
+#ifndef JOINSCHEDULER_H
+#define JOINSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QHash>
+#include <QList>
+#include <QElapsedTimer>
+#include "tokenbucket.h"
+
+// Collects channels waiting to be joined, spends the account-wide join
+// budget on them and emits comma-joined JOIN lines per connection.
+// Channels are tracked until the server confirms the join.
+class JoinScheduler : public QObject {
+    Q_OBJECT
+    
+public:
+    static constexpr int MaxLineLength = 500;
+    
+    explicit JoinScheduler(QObject* parent = nullptr);
+    
+    void setBudget(int joins, int periodMs);
+    void enqueue(int connection, const QString& channel);
+    void cancel(const QString& channel);
+    void cancelConnection(int connection);
+    void confirm(const QString& channel);
+    
+    int pendingCount() const { return pending.size(); }
+    int inflightCount() const { return inflight.size(); }
+    
+signals:
+    void sendLine(int connection, const QByteArray& line);
+    void channelJoined(const QString& channel, qint64 waitMs);
+    void allJoined(int channels, qint64 elapsedMs);
+    
+private slots:
+    void flush();
+    
+private:
+    struct PendingJoin {
+        int connection;
+        QString channel;
+        qint64 queuedAt;
+    };
+    
+    struct InflightJoin {
+        int connection;
+        qint64 queuedAt;
+    };
+    
+    TokenBucket bucket;
+    QTimer* flushTimer;
+    QElapsedTimer clock;
+    QList<PendingJoin> pending;
+    QHash<QString, InflightJoin> inflight;
+    qint64 sessionStart = -1;
+    int sessionJoins = 0;
+    
+    void schedule(qint64 delayMs);
+    void finishSessionIfIdle();
+};
+
+#endif
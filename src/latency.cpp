@@ -0,0 +1,121 @@
+#include "latency.h"
+#include <QDateTime>
+#include <QtAlgorithms>
+
+LatencyHistogram::LatencyHistogram() {
+    buckets.fill(0);
+}
+
+int LatencyHistogram::bucketFor(qint64 micros) {
+    if (micros < 16) {
+        return int(qMax<qint64>(0, micros));
+    }
+    int exponent = 63 - int(qCountLeadingZeroBits(quint64(micros)));
+    int sub = int(micros >> (exponent - 3)) & 7;
+    return qMin(BucketCount - 1, 16 + (exponent - 4) * 8 + sub);
+}
+
+qint64 LatencyHistogram::bucketValue(int bucket) {
+    if (bucket < 16) {
+        return bucket;
+    }
+    int exponent = (bucket - 16) / 8 + 4;
+    int sub = (bucket - 16) % 8;
+    qint64 width = qint64(1) << (exponent - 3);
+    return (8 + sub) * width + width / 2;
+}
+
+void LatencyHistogram::record(qint64 micros) {
+    buckets[bucketFor(micros)]++;
+    total++;
+    maximum = qMax(maximum, micros);
+}
+
+qint64 LatencyHistogram::percentile(double p) const {
+    if (total == 0) {
+        return 0;
+    }
+    
+    quint64 rank = quint64(p * (total - 1)) + 1;
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return qMin(bucketValue(i), maximum);
+        }
+    }
+    return maximum;
+}
+
+LatencySummary LatencyHistogram::summary() const {
+    LatencySummary result;
+    result.count = total;
+    result.p50 = percentile(0.50);
+    result.p99 = percentile(0.99);
+    result.max = maximum;
+    return result;
+}
+
+void LatencyHistogram::reset() {
+    buckets.fill(0);
+    total = 0;
+    maximum = 0;
+}
+
+LatencyMonitor& LatencyMonitor::instance() {
+    static LatencyMonitor inst;
+    return inst;
+}
+
+void LatencyMonitor::record(const QString& channel, const ChatMessage& msg) {
+    if (msg.readAt == 0 || msg.paintedAt == 0) {
+        return;
+    }
+    
+    std::array<LatencyHistogram, StageCount>& stages = histograms[channel];
+    stages[Parse].record((msg.parsedAt - msg.readAt) / 1000);
+    stages[Queue].record((msg.dispatchedAt - msg.parsedAt) / 1000);
+    stages[Render].record((msg.paintedAt - msg.dispatchedAt) / 1000);
+    
+    qint64 client = (msg.paintedAt - msg.readAt) / 1000;
+    stages[Client].record(client);
+    
+    // tmi-sent-ts is wall-clock time, so the server leg also absorbs any
+    // skew between Twitch's clock and ours.
+    if (msg.serverTime > 0) {
+        qint64 endToEnd = (QDateTime::currentMSecsSinceEpoch() - msg.serverTime) * 1000;
+        stages[EndToEnd].record(qMax<qint64>(0, endToEnd));
+        stages[Network].record(qMax<qint64>(0, endToEnd - client));
+    }
+}
+
+LatencySummary LatencyMonitor::summary(const QString& channel, Stage stage) const {
+    auto it = histograms.constFind(channel);
+    if (it == histograms.constEnd()) {
+        return LatencySummary();
+    }
+    return (*it)[stage].summary();
+}
+
+QStringList LatencyMonitor::channels() const {
+    QStringList result = histograms.keys();
+    result.sort();
+    return result;
+}
+
+void LatencyMonitor::reset() {
+    histograms.clear();
+}
+
+QString LatencyMonitor::stageName(Stage stage) {
+    switch (stage) {
+    case Network: return "network";
+    case Parse: return "parse";
+    case Queue: return "queue";
+    case Render: return "render";
+    case Client: return "client";
+    case EndToEnd: return "end-to-end";
+    case StageCount: break;
+    }
+    return QString();
+}
@@ -0,0 +1,87 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <array>
+#include <chrono>
+#include "chatmessage.h"
+
+namespace Latency {
+
+// Monotonic nanoseconds shared by every thread; the pipeline timestamps in
+// ChatMessage are all taken from this clock.
+inline qint64 now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+struct LatencySummary {
+    quint64 count = 0;
+    qint64 p50 = 0;
+    qint64 p99 = 0;
+    qint64 max = 0;
+};
+
+// Frame pacing of one chat view; batchSize holds messages per commit.
+struct RenderStats {
+    double framesPerSecond = 0.0;
+    double skippedPerSecond = 0.0;
+    int frameInterval = 0;
+    LatencySummary batchSize;
+};
+
+// Log-linear histogram of microsecond samples: exact below 16 us, then
+// eight buckets per power of two, so percentiles are within ~12%.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+    
+    void record(qint64 micros);
+    qint64 percentile(double p) const;
+    LatencySummary summary() const;
+    void reset();
+    
+private:
+    static constexpr int BucketCount = 16 + 40 * 8;
+    
+    std::array<quint32, BucketCount> buckets;
+    quint64 total = 0;
+    qint64 maximum = 0;
+    
+    static int bucketFor(qint64 micros);
+    static qint64 bucketValue(int bucket);
+};
+
+// Per-channel latency of every message that reached the screen. Samples
+// are recorded when a view paints them, on the GUI thread.
+class LatencyMonitor {
+public:
+    enum Stage {
+        Network,
+        Parse,
+        Queue,
+        Render,
+        Client,
+        EndToEnd,
+        StageCount
+    };
+    
+    static LatencyMonitor& instance();
+    
+    void record(const QString& channel, const ChatMessage& msg);
+    LatencySummary summary(const QString& channel, Stage stage) const;
+    QStringList channels() const;
+    void reset();
+    
+    static QString stageName(Stage stage);
+    
+private:
+    LatencyMonitor() = default;
+    QHash<QString, std::array<LatencyHistogram, StageCount>> histograms;
+};
+
+#endif
@@ -31,6 +31,16 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) {
     connect(auth, &TwitchAuth::tokenValidated, this, &MainWindow::onTokenValidated);
     connect(chat, &TwitchChat::connected, this, &MainWindow::onChatConnected);
     connect(chat, &TwitchChat::disconnected, this, &MainWindow::onChatDisconnected);
+    connect(chat, &TwitchChat::reconnecting, this, [this](int attempt, int delayMs) {
+        statusBar()->showMessage(QString("Connection lost, retrying in %1 s (attempt %2)")
+                                 .arg(delayMs / 1000.0, 0, 'f', 1).arg(attempt));
+    });
+    connect(chat, &TwitchChat::reconnected, this, [this](qint64 outageMs) {
+        statusBar()->showMessage(QString("Reconnected after %1 s").arg(outageMs / 1000.0, 0, 'f', 1), 5000);
+    });
+    connect(chat, &TwitchChat::joinsCompleted, this, [this](int channels, qint64 elapsedMs) {
+        statusBar()->showMessage(QString("Joined %1 channel(s) in %2 ms").arg(channels).arg(elapsedMs), 5000);
+    });
     
     mainSplitter = new QSplitter(Qt::Horizontal, this);
     
@@ -49,6 +59,7 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent) {
     mainSplitter->addWidget(chatTabs);
     
     statsWidget = new StatsWidget(this);
+    statsWidget->setChat(chat);
     statsWidget->setVisible(false);
     mainSplitter->addWidget(statsWidget);
     
@@ -224,18 +235,22 @@ void MainWindow::joinChannelDialog() {
     }
     
     ChatWidget* chatWidget = new ChatWidget(channel, chat, this);
-    connect(chat, &TwitchChat::messageReceived, chatWidget, &ChatWidget::onMessageReceived);
-    connect(chat, &TwitchChat::channelInfoUpdated, chatWidget, &ChatWidget::onChannelInfoUpdated);
+    ChannelFeed* feed = chat->feed(channel);
+    connect(feed, &ChannelFeed::messagesReceived, chatWidget, &ChatWidget::onMessagesReceived);
+    connect(feed, &ChannelFeed::channelInfoUpdated, chatWidget, &ChatWidget::onChannelInfoUpdated);
+    connect(feed, &ChannelFeed::messageDeleted, chatWidget, &ChatWidget::onMessageDeleted);
+    connect(feed, &ChannelFeed::chatCleared, chatWidget, &ChatWidget::onChatCleared);
+    connect(chatWidget, &ChatWidget::storeUsageChanged, statsWidget, &StatsWidget::setStoreUsage);
+    connect(chatWidget, &ChatWidget::renderStatsChanged, statsWidget, &StatsWidget::setRenderStats);
+    connect(chatWidget, &QObject::destroyed, statsWidget, [this, channel]() {
+        statsWidget->removeChannel(channel);
+    });
     
     chatWidgets[channel] = chatWidget;
     chatTabs->addTab(chatWidget, channel);
     chatTabs->setCurrentWidget(chatWidget);
     
     chat->joinChannel(channel);
-    
-    EmoteManager::instance().loadBTTVEmotes(channel);
-    EmoteManager::instance().loadFFZEmotes(channel);
-    EmoteManager::instance().load7TVEmotes(channel);
 }
 
 void MainWindow::leaveCurrentChannel() {
@@ -284,6 +299,11 @@ void MainWindow::updateTheme() {
 
 void MainWindow::applySettings() {
     updateTheme();
+    chat->setFrameInterval(Settings::instance().frameInterval);
+    
+    for (ChatWidget* widget : chatWidgets) {
+        widget->applyRetention();
+    }
     
     if (Settings::instance().alwaysOnTop) {
         setWindowFlags(windowFlags() | Qt::WindowStaysOnTopHint);
@@ -342,6 +362,30 @@ void MainWindow::showSettings() {
     lowCpuCheck->setChecked(Settings::instance().lowCpuMode);
     layout->addRow("Low CPU Mode:", lowCpuCheck);
     
+    QSpinBox* scrollbackSpin = new QSpinBox(&dialog);
+    scrollbackSpin->setRange(100, 1000000);
+    scrollbackSpin->setSingleStep(1000);
+    scrollbackSpin->setSuffix(" messages");
+    scrollbackSpin->setValue(Settings::instance().scrollbackMessages);
+    layout->addRow("Scrollback per Channel:", scrollbackSpin);
+    
+    QSpinBox* scrollbackMemorySpin = new QSpinBox(&dialog);
+    scrollbackMemorySpin->setRange(1, 1024);
+    scrollbackMemorySpin->setSuffix(" MB");
+    scrollbackMemorySpin->setValue(Settings::instance().scrollbackMegabytes);
+    layout->addRow("Scrollback Memory per Channel:", scrollbackMemorySpin);
+    
+    QCheckBox* networkThreadCheck = new QCheckBox(&dialog);
+    networkThreadCheck->setChecked(Settings::instance().networkThread);
+    networkThreadCheck->setToolTip("Read and parse chat on a background thread (takes effect after restart)");
+    layout->addRow("Network Thread:", networkThreadCheck);
+    
+    QSpinBox* frameIntervalSpin = new QSpinBox(&dialog);
+    frameIntervalSpin->setRange(1, 1000);
+    frameIntervalSpin->setSuffix(" ms");
+    frameIntervalSpin->setValue(Settings::instance().frameInterval);
+    layout->addRow("Message Batch Interval:", frameIntervalSpin);
+    
     QDialogButtonBox* buttons = new QDialogButtonBox(
         QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
     connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
@@ -359,6 +403,10 @@ void MainWindow::showSettings() {
         Settings::instance().soundAlerts = soundAlertsCheck->isChecked();
         Settings::instance().autoScroll = autoScrollCheck->isChecked();
         Settings::instance().lowCpuMode = lowCpuCheck->isChecked();
+        Settings::instance().scrollbackMessages = scrollbackSpin->value();
+        Settings::instance().scrollbackMegabytes = scrollbackMemorySpin->value();
+        Settings::instance().networkThread = networkThreadCheck->isChecked();
+        Settings::instance().frameInterval = frameIntervalSpin->value();
         Settings::instance().save();
         
         applySettings();
@@ -379,6 +427,7 @@ void MainWindow::showFilters() {
     layout->addWidget(buttons);
     
     dialog.exec();
+    updateTheme();
 }
 
 void MainWindow::showStats() {
@@ -0,0 +1,139 @@
+#include "messageformatter.h"
+#include "emotemanager.h"
+#include "settings.h"
+#include <QFontMetricsF>
+
+MessageFormatter::MessageFormatter() : emotes(&EmoteManager::instance().globalEmotes()) {
+    refresh(QFont());
+}
+
+void MessageFormatter::refresh(const QFont& font) {
+    settings = Settings::snapshot();
+    baseFont = font;
+    placeholderWidth = QFontMetricsF(font).horizontalAdvance(QChar(0x00A0));
+    
+    timestampFormat = QTextCharFormat();
+    timestampFormat.setForeground(QColor("#999999"));
+    timestampFormat.setProperty(QTextFormat::FontPixelSize, 10);
+    
+    nameFormat = QTextCharFormat();
+    nameFormat.setFontWeight(QFont::Bold);
+    
+    textFormat = QTextCharFormat();
+    
+    deletedFormat = QTextCharFormat();
+    deletedFormat.setFontItalic(true);
+    deletedFormat.setForeground(QColor("#888888"));
+    
+    deletedTagFormat = QTextCharFormat();
+    deletedTagFormat.setForeground(QColor("#ff0000"));
+    deletedTagFormat.setProperty(QTextFormat::FontPixelSize, 10);
+    
+    auto badge = [this](quint32 mask, const QString& label, const char* color) {
+        Badge entry{mask, label, nameFormat};
+        entry.format.setForeground(QColor(color));
+        badges.append(entry);
+    };
+    badges.clear();
+    badge(ChatUser::Broadcaster, "[BROADCASTER]", "#ffa500");
+    badge(ChatUser::Moderator, "[M]", "#00ff00");
+    badge(ChatUser::Vip, "[VIP]", "#ff00ff");
+    badge(ChatUser::Subscriber, "[SUB]", "#ff0000");
+    
+    cachedSecond = -1;
+}
+
+const QString& MessageFormatter::timestamp(const QDateTime& time) {
+    qint64 second = time.toSecsSinceEpoch();
+    if (second != cachedSecond) {
+        cachedSecond = second;
+        cachedTime = time.toString("hh:mm:ss");
+    }
+    return cachedTime;
+}
+
+void MessageFormatter::append(FormattedMessage& out, QStringView text, const QTextCharFormat& format) {
+    if (text.isEmpty()) {
+        return;
+    }
+    QTextLayout::FormatRange range;
+    range.start = int(out.text.size());
+    range.length = int(text.size());
+    range.format = format;
+    out.text += text;
+    out.formats.append(range);
+}
+
+void MessageFormatter::format(const ChatMessage& msg, FormattedMessage& out) {
+    out.text.clear();
+    out.formats.clear();
+    out.emotes.clear();
+    if (settings->version != Settings::snapshotVersion()) {
+        refresh(baseFont);
+    }
+    out.highlighted = settings->shouldHighlight(msg);
+    
+    if (settings->showTimestamps && msg.timestamp.isValid()) {
+        append(out, timestamp(msg.timestamp), timestampFormat);
+        out.text += ' ';
+    }
+    
+    const ChatUser& sender = msg.sender();
+    for (const Badge& badge : badges) {
+        if (sender.badges & badge.mask) {
+            append(out, badge.label, badge.format);
+            out.text += ' ';
+        }
+    }
+    
+    QColor nameColor(sender.colorName(settings->darkMode));
+    QTextCharFormat name = nameFormat;
+    name.setForeground(nameColor);
+    append(out, sender.displayName, name);
+    append(out, u": ", textFormat);
+    
+    if (msg.deleted && !settings->showDeletedMessages) {
+        append(out, u"<message deleted>", deletedFormat);
+        return;
+    }
+    
+    QTextCharFormat body = textFormat;
+    if (msg.isAction) {
+        body.setFontItalic(true);
+        body.setForeground(nameColor);
+    }
+    if (msg.deleted) {
+        body.setFontStrikeOut(true);
+    }
+    
+    QStringView text(msg.text);
+    int pos = 0;
+    if (settings->showEmotes) {
+        for (const EmoteRange& range : msg.emotes) {
+            if (range.start < pos) {
+                continue;
+            }
+            
+            Emote* emote = emotes->find(msg.emoteName(range));
+            if (!emote) {
+                continue;
+            }
+            
+            append(out, text.mid(pos, range.start - pos), body);
+            
+            QSize size(emote->width * settings->emoteScale / 100, emote->height * settings->emoteScale / 100);
+            QTextCharFormat placeholder = body;
+            placeholder.setFontLetterSpacingType(QFont::AbsoluteSpacing);
+            placeholder.setFontLetterSpacing(qMax<qreal>(0, size.width() - placeholderWidth));
+            out.emotes.append({int(out.text.size()), emote, size});
+            append(out, u"\u00A0", placeholder);
+            pos = range.end;
+        }
+    }
+    append(out, text.mid(pos), body);
+    
+    if (msg.deleted) {
+        out.text += ' ';
+        append(out, u"[DELETED]", deletedTagFormat);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef MESSAGEFORMATTER_H
+#define MESSAGEFORMATTER_H
+
+#include <QString>
+#include <QFont>
+#include <QTextLayout>
+#include <QTextCharFormat>
+#include <memory>
+#include "chatmessage.h"
+
+struct Emote;
+class EmoteSet;
+struct SettingsSnapshot;
+
+// An emote drawn over the placeholder character at position in the text.
+struct FormattedEmote {
+    int position = 0;
+    Emote* emote = nullptr;
+    QSize size;
+};
+
+struct FormattedMessage {
+    QString text;
+    QList<QTextLayout::FormatRange> formats;
+    QList<FormattedEmote> emotes;
+    bool highlighted = false;
+};
+
+// Turns a ChatMessage into plain text plus format ranges for QTextLayout.
+// Nothing goes through HTML, so message text needs no escaping; emotes
+// become a no-break space widened to the emote's size with letter spacing.
+// The settings-dependent pieces (badge labels, formats, sizes) are built
+// once in refresh() from the published settings snapshot, and rebuilt when
+// a newer one appears; the timestamp string is reused within a second.
+class MessageFormatter {
+public:
+    MessageFormatter();
+    
+    void refresh(const QFont& font);
+    void setEmotes(const EmoteSet* set) { emotes = set; }
+    void format(const ChatMessage& msg, FormattedMessage& out);
+    const QString& timestamp(const QDateTime& time);
+    
+private:
+    struct Badge {
+        quint32 mask;
+        QString label;
+        QTextCharFormat format;
+    };
+    
+    QFont baseFont;
+    qreal placeholderWidth = 0;
+    std::shared_ptr<const SettingsSnapshot> settings;
+    const EmoteSet* emotes;
+    
+    QList<Badge> badges;
+    QTextCharFormat timestampFormat;
+    QTextCharFormat nameFormat;
+    QTextCharFormat textFormat;
+    QTextCharFormat deletedFormat;
+    QTextCharFormat deletedTagFormat;
+    
+    qint64 cachedSecond = -1;
+    QString cachedTime;
+    
+    static void append(FormattedMessage& out, QStringView text, const QTextCharFormat& format);
+};
+
+#endif
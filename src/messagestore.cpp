@@ -0,0 +1,282 @@
+#include "messagestore.h"
+#include <cstring>
+
+// Emote ranges are packed after the text as start, end, id length, id.
+struct PackedEmote {
+    qint32 start;
+    qint32 end;
+    quint8 idBytes;
+};
+
+MessageStore::MessageStore(int maxMessages, qint64 maxBytes)
+    : capacity(qMax(1, maxMessages)), maxBytes(maxBytes), maxChunks(chunksFor(maxBytes)) {
+    records.resize(capacity);
+    chunks.resize(maxChunks);
+}
+
+// Enough chunks to hold maxBytes of payload plus the partly filled chunk
+// being written and the partly evicted one at the front.
+int MessageStore::chunksFor(qint64 bytes) {
+    return int(qBound<qint64>(2, bytes / ChunkSize + 2, 1 << 16));
+}
+
+// Evicts down to the new limits, then re-homes the resident records and
+// chunks in rings of the new size. Only runs when the settings change.
+void MessageStore::setLimits(int messages, qint64 bytes) {
+    messages = qMax(1, messages);
+    int newChunks = chunksFor(bytes);
+    if (messages == capacity && bytes == maxBytes && newChunks == maxChunks) {
+        return;
+    }
+    
+    while (head < tail && (size() > messages || usedBytes() > bytes ||
+                           writeChunk - record(head).chunk >= quint32(newChunks))) {
+        evictFront();
+    }
+    
+    std::vector<Record> newRecords(messages);
+    for (quint64 seq = head; seq < tail; ++seq) {
+        newRecords[seq % messages] = record(seq);
+    }
+    
+    std::vector<std::unique_ptr<char[]>> newChunkSlots(newChunks);
+    quint32 oldest = head < tail ? record(head).chunk : writeChunk;
+    for (quint32 chunk = oldest; chunk <= writeChunk; ++chunk) {
+        newChunkSlots[chunk % newChunks] = std::move(chunks[chunk % maxChunks]);
+    }
+    
+    records.swap(newRecords);
+    chunks.swap(newChunkSlots);
+    capacity = messages;
+    maxBytes = bytes;
+    maxChunks = newChunks;
+}
+
+MessageStore::~MessageStore() {
+    clear();
+}
+
+void MessageStore::clear() {
+    while (head < tail) {
+        evictFront();
+    }
+}
+
+// Returns space for a message in the current chunk, moving to the next one
+// when it does not fit. Once every slot has been allocated the next chunk
+// is the oldest one, so the messages still pointing into it are evicted.
+char* MessageStore::reserve(int bytes, quint32& chunk, quint32& offset) {
+    if (!chunks[writeChunk % maxChunks] || writeOffset + bytes > quint32(ChunkSize)) {
+        if (chunks[writeChunk % maxChunks]) {
+            writeChunk++;
+        }
+        writeOffset = 0;
+        
+        std::unique_ptr<char[]>& slot = chunks[writeChunk % maxChunks];
+        if (!slot) {
+            slot.reset(new char[ChunkSize]);
+        }
+        while (head < tail && record(head).chunk + quint32(maxChunks) <= writeChunk) {
+            evictFront();
+        }
+    }
+    
+    chunk = writeChunk;
+    offset = writeOffset;
+    writeOffset += bytes;
+    return chunks[writeChunk % maxChunks].get() + offset;
+}
+
+quint64 MessageStore::append(const ChatMessage& msg) {
+    QByteArray id = msg.id.toLatin1().left(0xff);
+    QByteArray text = msg.text.toUtf8();
+    
+    // Twitch caps a message at 500 characters, so these only guard against
+    // pathological input (say, an emotes tag repeating one range thousands
+    // of times) overflowing a chunk: emotes that would not fit are dropped,
+    // then the text is cut to what is left.
+    int emoteLimit = qMin(0xffff, ChunkSize - int(id.size()));
+    int emoteBytes = 0;
+    int emoteCount = 0;
+    for (const EmoteRange& range : msg.emotes) {
+        int packed = int(sizeof(PackedEmote)) + qMin(int(range.id.size()), 0xff);
+        if (emoteCount == 0xffff || emoteBytes + packed > emoteLimit) {
+            break;
+        }
+        emoteBytes += packed;
+        emoteCount++;
+    }
+    
+    int limit = ChunkSize - int(id.size()) - emoteBytes;
+    if (text.size() > limit) {
+        text.truncate(limit);
+    }
+    
+    if (tail - head == quint64(capacity)) {
+        evictFront();
+    }
+    
+    Record rec;
+    int bytes = int(id.size() + text.size()) + emoteBytes;
+    char* out = reserve(bytes, rec.chunk, rec.offset);
+    
+    std::memcpy(out, id.constData(), id.size());
+    out += id.size();
+    std::memcpy(out, text.constData(), text.size());
+    out += text.size();
+    for (int i = 0; i < emoteCount; ++i) {
+        const EmoteRange& range = msg.emotes[i];
+        QByteArray emoteId = range.id.toLatin1().left(0xff);
+        PackedEmote packed{range.start, range.end, quint8(emoteId.size())};
+        std::memcpy(out, &packed, sizeof(packed));
+        out += sizeof(packed);
+        std::memcpy(out, emoteId.constData(), emoteId.size());
+        out += emoteId.size();
+    }
+    
+    rec.timestamp = msg.timestamp.isValid() ? msg.timestamp.toMSecsSinceEpoch() : 0;
+    rec.serverTime = msg.serverTime;
+    rec.user = msg.user;
+    UserTable::instance().retain(msg.user);
+    rec.bits = msg.bits;
+    rec.textBytes = quint32(text.size());
+    rec.idBytes = quint16(id.size());
+    rec.emoteBytes = quint16(emoteBytes);
+    rec.emoteCount = quint16(emoteCount);
+    rec.flags = quint16((msg.deleted ? Deleted : 0) | (msg.isAction ? Action : 0) | (msg.highlighted ? Highlighted : 0));
+    
+    quint64 seq = tail++;
+    records[seq % capacity] = rec;
+    arenaBytes += bytes;
+    
+    // The newest message always stays, even if it alone is over the limit.
+    while (tail - head > 1 && usedBytes() > maxBytes) {
+        evictFront();
+    }
+    
+    if (!msg.id.isEmpty()) {
+        idIndex.insert(msg.id, seq);
+    }
+    const QString& userId = msg.sender().userId;
+    if (!userId.isEmpty()) {
+        userIndex[userId].append(seq);
+    }
+    return seq;
+}
+
+void MessageStore::evictFront() {
+    const Record& rec = record(head);
+    
+    if (rec.idBytes > 0) {
+        auto it = idIndex.find(QString::fromLatin1(data(rec), rec.idBytes));
+        if (it != idIndex.end() && it.value() == head) {
+            idIndex.erase(it);
+        }
+    }
+    auto it = userIndex.find(UserTable::instance().user(rec.user).userId);
+    if (it != userIndex.end() && !it->isEmpty() && it->first() == head) {
+        it->removeFirst();
+        if (it->isEmpty()) {
+            userIndex.erase(it);
+        }
+    }
+    UserTable::instance().release(rec.user);
+    
+    arenaBytes -= rec.idBytes + rec.textBytes + rec.emoteBytes;
+    head++;
+    evicted++;
+}
+
+ChatMessage MessageStore::message(quint64 seq) const {
+    ChatMessage msg;
+    if (!contains(seq)) {
+        return msg;
+    }
+    
+    const Record& rec = record(seq);
+    const char* in = data(rec);
+    msg.id = QString::fromLatin1(in, rec.idBytes);
+    in += rec.idBytes;
+    msg.text = QString::fromUtf8(in, rec.textBytes);
+    in += rec.textBytes;
+    
+    msg.emotes.reserve(rec.emoteCount);
+    for (int i = 0; i < rec.emoteCount; ++i) {
+        PackedEmote packed;
+        std::memcpy(&packed, in, sizeof(packed));
+        in += sizeof(packed);
+        msg.emotes.append({packed.start, packed.end, QString::fromLatin1(in, packed.idBytes)});
+        in += packed.idBytes;
+    }
+    
+    msg.user = rec.user;
+    msg.timestamp = rec.timestamp ? QDateTime::fromMSecsSinceEpoch(rec.timestamp) : QDateTime();
+    msg.serverTime = rec.serverTime;
+    msg.bits = rec.bits;
+    msg.deleted = rec.flags & Deleted;
+    msg.isAction = rec.flags & Action;
+    msg.highlighted = rec.flags & Highlighted;
+    return msg;
+}
+
+QString MessageStore::text(quint64 seq) const {
+    if (!contains(seq)) {
+        return QString();
+    }
+    const Record& rec = record(seq);
+    return QString::fromUtf8(data(rec) + rec.idBytes, rec.textBytes);
+}
+
+quint32 MessageStore::user(quint64 seq) const {
+    return contains(seq) ? record(seq).user : 0;
+}
+
+bool MessageStore::isDeleted(quint64 seq) const {
+    return contains(seq) && (record(seq).flags & Deleted);
+}
+
+bool MessageStore::setDeleted(quint64 seq) {
+    if (!contains(seq) || (record(seq).flags & Deleted)) {
+        return false;
+    }
+    records[seq % capacity].flags |= Deleted;
+    return true;
+}
+
+quint64 MessageStore::findId(const QString& messageId) const {
+    return idIndex.value(messageId, NoSeq);
+}
+
+QList<quint64> MessageStore::findUser(const QString& userId) const {
+    return userIndex.value(userId);
+}
+
+qint64 MessageStore::usedBytes() const {
+    return arenaBytes + qint64(size()) * qint64(sizeof(Record));
+}
+
+qint64 MessageStore::allocatedBytes() const {
+    qint64 total = qint64(capacity) * qint64(sizeof(Record));
+    for (const std::unique_ptr<char[]>& chunk : chunks) {
+        if (chunk) {
+            total += ChunkSize;
+        }
+    }
+    return total;
+}
+
+double MessageStore::bytesPerMessage() const {
+    return size() > 0 ? double(usedBytes()) / size() : 0.0;
+}
+
+StoreUsage MessageStore::usage() const {
+    StoreUsage result;
+    result.messages = size();
+    result.firstSeq = head;
+    result.endSeq = tail;
+    result.evicted = evicted;
+    result.usedBytes = usedBytes();
+    result.allocatedBytes = allocatedBytes();
+    result.bytesPerMessage = bytesPerMessage();
+    return result;
+}
@@ -0,0 +1,114 @@
+#ifndef MESSAGESTORE_H
+#define MESSAGESTORE_H
+
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <memory>
+#include <vector>
+#include "chatmessage.h"
+
+struct StoreUsage {
+    int messages = 0;
+    quint64 firstSeq = 0;
+    quint64 endSeq = 0;
+    quint64 evicted = 0;
+    qint64 usedBytes = 0;
+    qint64 allocatedBytes = 0;
+    double bytesPerMessage = 0.0;
+};
+
+// Per-channel message history in a compact layout. Each message is one
+// fixed-size record in a ring; its id, UTF-8 text and emote ranges live
+// back to back in a chunked arena, and the sender is a UserTable handle
+// that the store retains until the message is evicted.
+// Retention is bounded both in messages and in bytes (records plus arena
+// payload); append() evicts from the front until both limits hold again,
+// which is amortized O(1) since every message is evicted at most once.
+// Arena chunks are sized from the byte limit and recycled as the ring
+// wraps. Messages are addressed by a sequence number that keeps counting
+// across evictions: [firstSeq(), endSeq()) is what is still resident, and
+// anything layered on top can compare its own seqs against that range.
+class MessageStore {
+public:
+    static constexpr int ChunkSize = 64 * 1024;
+    static constexpr quint64 NoSeq = ~quint64(0);
+    
+    static constexpr int DefaultMessages = 10000;
+    static constexpr qint64 DefaultBytes = 16 * 1024 * 1024;
+    
+    explicit MessageStore(int maxMessages = DefaultMessages, qint64 maxBytes = DefaultBytes);
+    ~MessageStore();
+    MessageStore(const MessageStore&) = delete;
+    MessageStore& operator=(const MessageStore&) = delete;
+    
+    void setLimits(int maxMessages, qint64 maxBytes);
+    int messageLimit() const { return capacity; }
+    qint64 byteLimit() const { return maxBytes; }
+    
+    quint64 append(const ChatMessage& msg);
+    void clear();
+    
+    bool contains(quint64 seq) const { return seq >= head && seq < tail; }
+    quint64 firstSeq() const { return head; }
+    quint64 endSeq() const { return tail; }
+    int size() const { return int(tail - head); }
+    quint64 evictedCount() const { return evicted; }
+    
+    ChatMessage message(quint64 seq) const;
+    QString text(quint64 seq) const;
+    quint32 user(quint64 seq) const;
+    bool isDeleted(quint64 seq) const;
+    bool setDeleted(quint64 seq);
+    
+    quint64 findId(const QString& messageId) const;
+    QList<quint64> findUser(const QString& userId) const;
+    
+    qint64 usedBytes() const;
+    qint64 allocatedBytes() const;
+    double bytesPerMessage() const;
+    StoreUsage usage() const;
+    
+private:
+    enum Flag : quint16 {
+        Deleted = 1 << 0,
+        Action = 1 << 1,
+        Highlighted = 1 << 2
+    };
+    
+    struct Record {
+        qint64 timestamp;
+        qint64 serverTime;
+        quint32 user;
+        qint32 bits;
+        quint32 chunk;
+        quint32 offset;
+        quint32 textBytes;
+        quint16 idBytes;
+        quint16 emoteBytes;
+        quint16 emoteCount;
+        quint16 flags;
+    };
+    
+    int capacity;
+    qint64 maxBytes;
+    int maxChunks;
+    std::vector<Record> records;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    quint32 writeChunk = 0;
+    quint32 writeOffset = 0;
+    quint64 head = 0;
+    quint64 tail = 0;
+    qint64 arenaBytes = 0;
+    quint64 evicted = 0;
+    QHash<QString, quint64> idIndex;
+    QHash<QString, QList<quint64>> userIndex;
+    
+    const Record& record(quint64 seq) const { return records[seq % capacity]; }
+    static int chunksFor(qint64 bytes);
+    const char* data(const Record& rec) const { return chunks[rec.chunk % maxChunks].get() + rec.offset; }
+    char* reserve(int bytes, quint32& chunk, quint32& offset);
+    void evictFront();
+};
+
+#endif
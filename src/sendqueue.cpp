@@ -0,0 +1,126 @@
+#include "sendqueue.h"
+#include <QMap>
+
+SendQueue::SendQueue(QObject* parent)
+    : QObject(parent), normalBucket(20, 30000), modBucket(100, 30000) {
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    connect(flushTimer, &QTimer::timeout, this, &SendQueue::flush);
+    clock.start();
+}
+
+void SendQueue::setBudget(int messages, int modMessages, int periodMs) {
+    normalBucket.configure(messages, periodMs);
+    modBucket.configure(modMessages, periodMs);
+}
+
+void SendQueue::setModerator(const QString& channel, bool moderator) {
+    if (moderator) {
+        moderated.insert(channel);
+    } else {
+        moderated.remove(channel);
+    }
+}
+
+void SendQueue::enqueue(int connection, const QString& channel, const QByteArray& line) {
+    pending.append({connection, channel, line, clock.elapsed(), false});
+    schedule(0);
+}
+
+void SendQueue::enqueueRaw(int connection, const QByteArray& line) {
+    raw.append({connection, QString(), line, clock.elapsed(), false});
+    schedule(0);
+}
+
+// Raw lines (JOINs) are re-issued by their owner after a reconnect, so
+// only those are dropped; chat lines wait for resumeConnection().
+void SendQueue::cancelConnection(int connection) {
+    online.remove(connection);
+    raw.removeIf([connection](const PendingLine& item) {
+        return item.connection == connection;
+    });
+}
+
+void SendQueue::resumeConnection(int connection) {
+    online.insert(connection);
+    if (!pending.isEmpty()) {
+        schedule(0);
+    }
+}
+
+bool SendQueue::take(const QString& channel) {
+    if (moderated.contains(channel)) {
+        return modBucket.tryTake();
+    }
+    if (normalBucket.available() < 1 || modBucket.available() < 1) {
+        return false;
+    }
+    normalBucket.tryTake();
+    modBucket.tryTake();
+    return true;
+}
+
+qint64 SendQueue::msUntilAvailable(const QString& channel) {
+    if (moderated.contains(channel)) {
+        return modBucket.msUntilAvailable();
+    }
+    return qMax(normalBucket.msUntilAvailable(), modBucket.msUntilAvailable());
+}
+
+void SendQueue::schedule(qint64 delayMs) {
+    if (flushTimer->isActive() && flushTimer->remainingTime() <= delayMs) {
+        return;
+    }
+    flushTimer->start(int(delayMs));
+}
+
+void SendQueue::flush() {
+    QMap<int, QByteArray> buffers;
+    qint64 now = clock.elapsed();
+    
+    for (const PendingLine& item : raw) {
+        if (online.contains(item.connection)) {
+            buffers[item.connection] += item.line;
+        }
+    }
+    raw.clear();
+    
+    // take() refills the buckets as it goes, so once a line of a channel is
+    // blocked every later line of that channel is held back too; otherwise
+    // a token freed mid-loop could send it ahead of the earlier one. Lines
+    // for a connection that is down are left for resumeConnection().
+    qint64 wait = -1;
+    QSet<QString> blocked;
+    for (int i = 0; i < pending.size();) {
+        if (!online.contains(pending[i].connection)) {
+            ++i;
+            continue;
+        }
+        if (blocked.contains(pending[i].channel) || !take(pending[i].channel)) {
+            blocked.insert(pending[i].channel);
+            pending[i].throttled = true;
+            qint64 needed = msUntilAvailable(pending[i].channel);
+            wait = wait < 0 ? needed : qMin(wait, needed);
+            ++i;
+            continue;
+        }
+        
+        PendingLine item = pending.takeAt(i);
+        qint64 delay = now - item.queuedAt;
+        lastDelayMs = delay;
+        maxDelayMs = qMax(maxDelayMs, delay);
+        if (item.throttled) {
+            emit messageDelayed(item.channel, delay);
+        }
+        
+        buffers[item.connection] += item.line;
+    }
+    
+    for (auto it = buffers.constBegin(); it != buffers.constEnd(); ++it) {
+        emit sendBuffer(it.key(), it.value());
+    }
+    
+    if (wait >= 0) {
+        schedule(qMax<qint64>(1, wait));
+    }
+}
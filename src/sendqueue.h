@@ -0,0 +1,66 @@
+#ifndef SENDQUEUE_H
+#define SENDQUEUE_H
+
+#include <QObject>
+#include <QTimer>
+#include <QList>
+#include <QSet>
+#include <QElapsedTimer>
+#include "tokenbucket.h"
+
+// Outgoing chat lines waiting for the account's send budget. Messages in
+// channels where we moderate draw from the moderator bucket only; all other
+// messages also need a token from the normal bucket. Everything released
+// in one flush is handed out as a single buffer per connection. Chat lines
+// for a connection that is down stay queued, without spending tokens,
+// until it is resumed; raw lines for it are dropped.
+class SendQueue : public QObject {
+    Q_OBJECT
+    
+public:
+    explicit SendQueue(QObject* parent = nullptr);
+    
+    void setBudget(int messages, int modMessages, int periodMs);
+    void setModerator(const QString& channel, bool moderator);
+    void enqueue(int connection, const QString& channel, const QByteArray& line);
+    void enqueueRaw(int connection, const QByteArray& line);
+    void cancelConnection(int connection);
+    void resumeConnection(int connection);
+    
+    int pendingCount() const { return pending.size(); }
+    qint64 lastDelay() const { return lastDelayMs; }
+    qint64 maxDelay() const { return maxDelayMs; }
+    
+signals:
+    void sendBuffer(int connection, const QByteArray& data);
+    void messageDelayed(const QString& channel, qint64 delayMs);
+    
+private slots:
+    void flush();
+    
+private:
+    struct PendingLine {
+        int connection;
+        QString channel;
+        QByteArray line;
+        qint64 queuedAt;
+        bool throttled;
+    };
+    
+    TokenBucket normalBucket;
+    TokenBucket modBucket;
+    QTimer* flushTimer;
+    QElapsedTimer clock;
+    QList<PendingLine> pending;
+    QList<PendingLine> raw;
+    QSet<QString> moderated;
+    QSet<int> online;
+    qint64 lastDelayMs = 0;
+    qint64 maxDelayMs = 0;
+    
+    bool take(const QString& channel);
+    qint64 msUntilAvailable(const QString& channel);
+    void schedule(qint64 delayMs);
+};
+
+#endif
@@ -1,15 +1,73 @@
 #include "settings.h"
+#include "highlightmatcher.h"
+#include "chatmessage.h"
 #include <QFile>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QStandardPaths>
 #include <QDir>
+#include <atomic>
+
+static std::shared_ptr<const SettingsSnapshot> published;
+static std::atomic<quint64> publishedVersion{0};
 
 Settings& Settings::instance() {
     static Settings inst;
     return inst;
 }
 
+// Builds a snapshot from the current fields and swaps it in. Readers that
+// still hold the previous one keep it alive until they let go.
+void Settings::publish() {
+    auto next = std::make_shared<SettingsSnapshot>();
+    next->version = publishedVersion.load() + 1;
+    for (const QString& user : mutedUsers) {
+        next->mutedUsers.insert(user.trimmed().toLower());
+    }
+    next->highlights = std::make_shared<const HighlightMatcher>(highlightedUsers, highlightKeywords,
+                                                                highlightWholeWords);
+    next->username = username.toLower();
+    next->highlightOwnMessages = highlightOwnMessages;
+    next->showTimestamps = showTimestamps;
+    next->showEmotes = showEmotes;
+    next->showDeletedMessages = showDeletedMessages;
+    next->animatedEmotes = animatedEmotes;
+    next->compactMode = compactMode;
+    next->darkMode = darkMode;
+    next->emoteScale = emoteScale;
+    
+    std::atomic_store(&published, std::shared_ptr<const SettingsSnapshot>(std::move(next)));
+    publishedVersion.fetch_add(1);
+}
+
+std::shared_ptr<const SettingsSnapshot> Settings::snapshot() {
+    std::shared_ptr<const SettingsSnapshot> current = std::atomic_load(&published);
+    if (!current) {
+        instance().publish();
+        current = std::atomic_load(&published);
+    }
+    return current;
+}
+
+// Cheap to poll per message: callers compare it with the version of the
+// snapshot they hold and only fetch a new one when it moved.
+quint64 Settings::snapshotVersion() {
+    return publishedVersion.load(std::memory_order_acquire);
+}
+
+bool SettingsSnapshot::shouldHighlight(const ChatMessage& msg) const {
+    const QString& login = msg.sender().login;
+    if (highlights->matchesUser(login) || highlights->matchesText(msg.text)) {
+        return true;
+    }
+    
+    if (highlightOwnMessages && !login.isEmpty() && login == username) {
+        return true;
+    }
+    
+    return false;
+}
+
 QString Settings::configPath() {
     QString path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
     QDir dir(path);
@@ -22,6 +80,7 @@ QString Settings::configPath() {
 void Settings::load() {
     QFile file(configPath());
     if (!file.open(QIODevice::ReadOnly)) {
+        publish();
         return;
     }
     
@@ -88,18 +147,37 @@ void Settings::load() {
     showViewerCount = obj["showViewerCount"].toBool(true);
     showStreamInfo = obj["showStreamInfo"].toBool(true);
     highlightOwnMessages = obj["highlightOwnMessages"].toBool(true);
+    highlightWholeWords = obj["highlightWholeWords"].toBool(false);
     showRawIrc = obj["showRawIrc"].toBool(false);
+    networkThread = obj["networkThread"].toBool(false);
     systemTray = obj["systemTray"].toBool(true);
     
     fontSize = obj["fontSize"].toInt(12);
     emoteScale = obj["emoteScale"].toInt(100);
     chatOpacity = obj["chatOpacity"].toInt(100);
     messageRateLimit = obj["messageRateLimit"].toInt(500);
+    frameInterval = obj["frameInterval"].toInt(16);
+    scrollbackMessages = obj["scrollbackMessages"].toInt(10000);
+    scrollbackMegabytes = obj["scrollbackMegabytes"].toInt(16);
+    connectionPoolSize = obj["connectionPoolSize"].toInt(1);
+    channelsPerConnection = obj["channelsPerConnection"].toInt(100);
+    connectionPolicy = obj["connectionPolicy"].toString("round-robin");
+    ircHost = obj["ircHost"].toString("irc.chat.twitch.tv");
+    ircPort = obj["ircPort"].toInt(6667);
+    joinRateLimit = obj["joinRateLimit"].toInt(20);
+    joinRateWindow = obj["joinRateWindow"].toInt(10000);
+    sendRateLimit = obj["sendRateLimit"].toInt(20);
+    modSendRateLimit = obj["modSendRateLimit"].toInt(100);
+    sendRateWindow = obj["sendRateWindow"].toInt(30000);
     customFont = obj["customFont"].toString("Segoe UI");
     theme = obj["theme"].toString("dark");
+    
+    publish();
 }
 
 void Settings::save() {
+    publish();
+    
     QJsonObject obj;
     
     obj["accessToken"] = accessToken;
@@ -156,13 +234,28 @@ void Settings::save() {
     obj["showViewerCount"] = showViewerCount;
     obj["showStreamInfo"] = showStreamInfo;
     obj["highlightOwnMessages"] = highlightOwnMessages;
+    obj["highlightWholeWords"] = highlightWholeWords;
     obj["showRawIrc"] = showRawIrc;
+    obj["networkThread"] = networkThread;
     obj["systemTray"] = systemTray;
     
     obj["fontSize"] = fontSize;
     obj["emoteScale"] = emoteScale;
     obj["chatOpacity"] = chatOpacity;
     obj["messageRateLimit"] = messageRateLimit;
+    obj["frameInterval"] = frameInterval;
+    obj["scrollbackMessages"] = scrollbackMessages;
+    obj["scrollbackMegabytes"] = scrollbackMegabytes;
+    obj["connectionPoolSize"] = connectionPoolSize;
+    obj["channelsPerConnection"] = channelsPerConnection;
+    obj["connectionPolicy"] = connectionPolicy;
+    obj["ircHost"] = ircHost;
+    obj["ircPort"] = ircPort;
+    obj["joinRateLimit"] = joinRateLimit;
+    obj["joinRateWindow"] = joinRateWindow;
+    obj["sendRateLimit"] = sendRateLimit;
+    obj["modSendRateLimit"] = modSendRateLimit;
+    obj["sendRateWindow"] = sendRateWindow;
     obj["customFont"] = customFont;
     obj["theme"] = theme;
     
@@ -6,6 +6,32 @@
 #include <QStringList>
 #include <QFont>
 #include <QColor>
+#include <QSet>
+#include <memory>
+
+class HighlightMatcher;
+struct ChatMessage;
+
+// The settings the per-message path reads, frozen at the time they were
+// published. Filters are hash sets or a compiled matcher and names are
+// already lowered. Snapshots are immutable, so any thread may read one
+// without locking; a new one replaces the pointer on every load or save.
+struct SettingsSnapshot {
+    quint64 version = 0;
+    QSet<QString> mutedUsers;
+    std::shared_ptr<const HighlightMatcher> highlights;
+    QString username;
+    bool highlightOwnMessages = true;
+    bool showTimestamps = true;
+    bool showEmotes = true;
+    bool showDeletedMessages = false;
+    bool animatedEmotes = true;
+    bool compactMode = false;
+    bool darkMode = true;
+    int emoteScale = 100;
+    
+    bool shouldHighlight(const ChatMessage& msg) const;
+};
 
 class Settings {
 public:
@@ -13,6 +39,10 @@ public:
     
     void load();
     void save();
+    void publish();
+    
+    static std::shared_ptr<const SettingsSnapshot> snapshot();
+    static quint64 snapshotVersion();
     
     QString accessToken;
     QString refreshToken;
@@ -42,12 +72,27 @@ public:
     bool showViewerCount = true;
     bool showStreamInfo = true;
     bool highlightOwnMessages = true;
+    bool highlightWholeWords = false;
     bool showRawIrc = false;
+    bool networkThread = false;
     
     int fontSize = 12;
     int emoteScale = 100;
     int chatOpacity = 100;
     int messageRateLimit = 500;
+    int frameInterval = 16;
+    int scrollbackMessages = 10000;
+    int scrollbackMegabytes = 16;
+    int connectionPoolSize = 1;
+    int channelsPerConnection = 100;
+    QString connectionPolicy = "round-robin";
+    QString ircHost = "irc.chat.twitch.tv";
+    int ircPort = 6667;
+    int joinRateLimit = 20;
+    int joinRateWindow = 10000;
+    int sendRateLimit = 20;
+    int modSendRateLimit = 100;
+    int sendRateWindow = 30000;
     QString customFont = "Segoe UI";
     
     QString theme = "dark";
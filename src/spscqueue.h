@@ -0,0 +1,75 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <vector>
+
+// Bounded single-producer/single-consumer ring. push() only ever runs on the
+// producer thread and pop() only on the consumer thread; neither blocks.
+// When the ring is full the new item is dropped and counted.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(int capacity) {
+        int size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buffer.resize(size);
+        mask = quint64(size - 1);
+    }
+    
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    
+    bool push(T&& item) {
+        quint64 h = head.load(std::memory_order_relaxed);
+        quint64 t = tail.load(std::memory_order_acquire);
+        if (h - t > mask) {
+            drops.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        
+        buffer[h & mask] = std::move(item);
+        head.store(h + 1, std::memory_order_release);
+        
+        quint64 depth = h + 1 - t;
+        if (depth > peak.load(std::memory_order_relaxed)) {
+            peak.store(depth, std::memory_order_relaxed);
+        }
+        return true;
+    }
+    
+    bool pop(T& item) {
+        quint64 t = tail.load(std::memory_order_relaxed);
+        quint64 h = head.load(std::memory_order_acquire);
+        if (t == h) {
+            return false;
+        }
+        
+        item = std::move(buffer[t & mask]);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+    
+    int size() const {
+        quint64 t = tail.load(std::memory_order_acquire);
+        quint64 h = head.load(std::memory_order_acquire);
+        return int(h - t);
+    }
+    
+    int capacity() const { return int(mask + 1); }
+    int highWater() const { return int(peak.load(std::memory_order_relaxed)); }
+    quint64 dropped() const { return drops.load(std::memory_order_relaxed); }
+    
+private:
+    std::vector<T> buffer;
+    quint64 mask = 0;
+    alignas(64) std::atomic<quint64> head{0};
+    alignas(64) std::atomic<quint64> tail{0};
+    alignas(64) std::atomic<quint64> drops{0};
+    std::atomic<quint64> peak{0};
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "statswidget.h"
+#include "latency.h"
 #include <QDateTime>
 #include <algorithm>
 
@@ -8,10 +9,18 @@ StatsWidget::StatsWidget(QWidget* parent) : QWidget(parent) {
     messagesPerMinLabel = new QLabel("Messages/min: 0", this);
     topUsersLabel = new QLabel("Top Users:", this);
     topEmotesLabel = new QLabel("Top Emotes:", this);
+    pipelineLabel = new QLabel("Queue: 0", this);
+    latencyLabel = new QLabel("Latency:", this);
+    storeLabel = new QLabel("History:", this);
+    renderLabel = new QLabel("Rendering:", this);
     
     layout->addWidget(messagesPerMinLabel);
     layout->addWidget(topUsersLabel);
     layout->addWidget(topEmotesLabel);
+    layout->addWidget(pipelineLabel);
+    layout->addWidget(latencyLabel);
+    layout->addWidget(storeLabel);
+    layout->addWidget(renderLabel);
     layout->addStretch();
     
     updateTimer = new QTimer(this);
@@ -30,6 +39,23 @@ void StatsWidget::addMessage(const QString& username) {
     }
 }
 
+void StatsWidget::setChat(TwitchChat* chat) {
+    chatConnection = chat;
+}
+
+void StatsWidget::setStoreUsage(const QString& channel, const StoreUsage& usage) {
+    storeUsage[channel] = usage;
+}
+
+void StatsWidget::setRenderStats(const QString& channel, const RenderStats& stats) {
+    renderStats[channel] = stats;
+}
+
+void StatsWidget::removeChannel(const QString& channel) {
+    storeUsage.remove(channel);
+    renderStats.remove(channel);
+}
+
 void StatsWidget::addEmote(const QString& emote) {
     emoteCounts[emote]++;
 }
@@ -68,11 +94,71 @@ void StatsWidget::updateDisplay() {
         topEmotes += QString("%1: %2\n").arg(emoteList[i].first).arg(emoteList[i].second);
     }
     topEmotesLabel->setText(topEmotes);
+    
+    if (chatConnection) {
+        PipelineStats stats = chatConnection->pipelineStats();
+        pipelineLabel->setText(QString("Connections: %1\nQueue: %2/%3 (peak %4)\nDropped: %5\n"
+                                       "Outgoing: %6 queued (delay %7 ms, max %8 ms)\n"
+                                       "Reconnects: %9 (last outage %10 ms, longest %11 ms)%12")
+                               .arg(stats.connections)
+                               .arg(stats.queueDepth)
+                               .arg(stats.queueCapacity)
+                               .arg(stats.queueHighWater)
+                               .arg(stats.dropped)
+                               .arg(stats.sendQueueDepth)
+                               .arg(stats.sendLastDelay)
+                               .arg(stats.sendMaxDelay)
+                               .arg(stats.reconnects)
+                               .arg(stats.lastOutage)
+                               .arg(stats.longestOutage)
+                               .arg(stats.threaded ? "\nNetwork thread: on" : ""));
+    }
+    
+    LatencyMonitor& monitor = LatencyMonitor::instance();
+    QString latency = "Latency (p50/p99/max ms):\n";
+    for (const QString& channel : monitor.channels()) {
+        latency += channel + "\n";
+        for (LatencyMonitor::Stage stage : {LatencyMonitor::Client, LatencyMonitor::EndToEnd}) {
+            LatencySummary summary = monitor.summary(channel, stage);
+            latency += QString("  %1: %2 / %3 / %4\n")
+                       .arg(LatencyMonitor::stageName(stage))
+                       .arg(summary.p50 / 1000.0, 0, 'f', 1)
+                       .arg(summary.p99 / 1000.0, 0, 'f', 1)
+                       .arg(summary.max / 1000.0, 0, 'f', 1);
+        }
+    }
+    latencyLabel->setText(latency.trimmed());
+    
+    QString history = "History:\n";
+    for (auto it = storeUsage.constBegin(); it != storeUsage.constEnd(); ++it) {
+        history += QString("%1: %2 msgs, %3 KB (%4 KB allocated), %5 bytes/msg, %6 evicted\n")
+                   .arg(it.key())
+                   .arg(it->messages)
+                   .arg(it->usedBytes / 1024)
+                   .arg(it->allocatedBytes / 1024)
+                   .arg(it->bytesPerMessage, 0, 'f', 1)
+                   .arg(it->evicted);
+    }
+    storeLabel->setText(history.trimmed());
+    
+    QString rendering = "Rendering (batch p50/p99/max):\n";
+    for (auto it = renderStats.constBegin(); it != renderStats.constEnd(); ++it) {
+        rendering += QString("%1: %2 fps of %3, %4 skipped/s, batch %5 / %6 / %7\n")
+                     .arg(it.key())
+                     .arg(it->framesPerSecond, 0, 'f', 1)
+                     .arg(1000 / qMax(1, it->frameInterval))
+                     .arg(it->skippedPerSecond, 0, 'f', 1)
+                     .arg(it->batchSize.p50)
+                     .arg(it->batchSize.p99)
+                     .arg(it->batchSize.max);
+    }
+    renderLabel->setText(rendering.trimmed());
 }
 
 void StatsWidget::reset() {
     messageTimes.clear();
     userCounts.clear();
     emoteCounts.clear();
+    LatencyMonitor::instance().reset();
     updateDisplay();
 }
@@ -6,6 +6,9 @@
 #include <QVBoxLayout>
 #include <QTimer>
 #include <QMap>
+#include "twitchchat.h"
+#include "messagestore.h"
+#include "latency.h"
 
 class StatsWidget : public QWidget {
     Q_OBJECT
@@ -16,6 +19,12 @@ public:
     void addMessage(const QString& username);
     void addEmote(const QString& emote);
     void reset();
+    void setChat(TwitchChat* chat);
+    
+public slots:
+    void setStoreUsage(const QString& channel, const StoreUsage& usage);
+    void setRenderStats(const QString& channel, const RenderStats& stats);
+    void removeChannel(const QString& channel);
     
 private slots:
     void updateDisplay();
@@ -24,11 +33,18 @@ private:
     QLabel* messagesPerMinLabel;
     QLabel* topUsersLabel;
     QLabel* topEmotesLabel;
+    QLabel* pipelineLabel;
+    QLabel* latencyLabel;
+    QLabel* storeLabel;
+    QLabel* renderLabel;
     
+    TwitchChat* chatConnection = nullptr;
     QTimer* updateTimer;
     QList<qint64> messageTimes;
     QMap<QString, int> userCounts;
     QMap<QString, int> emoteCounts;
+    QMap<QString, StoreUsage> storeUsage;
+    QMap<QString, RenderStats> renderStats;
 };
 
 #endif
@@ -0,0 +1,42 @@
+#include "tokenbucket.h"
+#include <QtMath>
+
+TokenBucket::TokenBucket(double capacity, qint64 periodMs) {
+    clock.start();
+    configure(capacity, periodMs);
+}
+
+void TokenBucket::configure(double newCapacity, qint64 periodMs) {
+    capacity = qMax(1.0, newCapacity);
+    refillPerMs = capacity / qMax<qint64>(1, periodMs);
+    tokens = capacity;
+    lastRefill = clock.elapsed();
+}
+
+void TokenBucket::refill() {
+    qint64 now = clock.elapsed();
+    tokens = qMin(capacity, tokens + (now - lastRefill) * refillPerMs);
+    lastRefill = now;
+}
+
+bool TokenBucket::tryTake(double count) {
+    refill();
+    if (tokens < count) {
+        return false;
+    }
+    tokens -= count;
+    return true;
+}
+
+double TokenBucket::available() {
+    refill();
+    return tokens;
+}
+
+qint64 TokenBucket::msUntilAvailable(double count) {
+    refill();
+    if (tokens >= count) {
+        return 0;
+    }
+    return qCeil((count - tokens) / refillPerMs);
+}
@@ -0,0 +1,28 @@
+#ifndef TOKENBUCKET_H
+#define TOKENBUCKET_H
+
+#include <QElapsedTimer>
+
+// Classic token bucket: holds up to `capacity` tokens and refills the whole
+// capacity once per `periodMs`. Not thread-safe; each owner keeps its own.
+class TokenBucket {
+public:
+    TokenBucket(double capacity = 1, qint64 periodMs = 1000);
+    
+    void configure(double capacity, qint64 periodMs);
+    
+    bool tryTake(double count = 1);
+    double available();
+    qint64 msUntilAvailable(double count = 1);
+    
+private:
+    void refill();
+    
+    double capacity;
+    double tokens;
+    double refillPerMs;
+    qint64 lastRefill = 0;
+    QElapsedTimer clock;
+};
+
+#endif
@@ -1,58 +1,222 @@
 #include "twitchchat.h"
 #include "settings.h"
 #include "constants.h"
-#include <QRegularExpression>
+#include "latency.h"
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QUrlQuery>
 
 TwitchChat::TwitchChat(QObject* parent) : QObject(parent) {
-    socket = new QTcpSocket(this);
-    pingTimer = new QTimer(this);
     nam = new QNetworkAccessManager(this);
+    frameTimer = new QTimer(this);
+    infoTimer = new QTimer(this);
+    joinScheduler = new JoinScheduler(this);
+    sendQueue = new SendQueue(this);
+    workerThread = nullptr;
+    setServer(Settings::instance().ircHost, quint16(Settings::instance().ircPort));
     
-    connect(socket, &QTcpSocket::connected, this, &TwitchChat::onConnected);
-    connect(socket, &QTcpSocket::disconnected, this, &TwitchChat::onDisconnected);
-    connect(socket, &QTcpSocket::readyRead, this, &TwitchChat::onReadyRead);
-    connect(socket, &QTcpSocket::errorOccurred, this, &TwitchChat::onError);
+    if (Settings::instance().networkThread) {
+        workerThread = new QThread(this);
+        workerThread->setObjectName("TwitchChatNetwork");
+        workerThread->start();
+    }
+    
+    connect(frameTimer, &QTimer::timeout, this, &TwitchChat::drainEvents);
+    frameTimer->setTimerType(Qt::PreciseTimer);
+    setFrameInterval(Settings::instance().frameInterval);
+    
+    infoTimer->setSingleShot(true);
+    infoTimer->setInterval(250);
+    connect(infoTimer, &QTimer::timeout, this, &TwitchChat::requestChannelInfo);
+    
+    joinScheduler->setBudget(Settings::instance().joinRateLimit, Settings::instance().joinRateWindow);
+    connect(joinScheduler, &JoinScheduler::sendLine, sendQueue, &SendQueue::enqueueRaw);
     
-    connect(pingTimer, &QTimer::timeout, this, &TwitchChat::handlePing);
-    pingTimer->setInterval(60000);
+    sendQueue->setBudget(Settings::instance().sendRateLimit, Settings::instance().modSendRateLimit,
+                         Settings::instance().sendRateWindow);
+    connect(sendQueue, &SendQueue::sendBuffer, this, [this](int index, const QByteArray& data) {
+        IrcConnection* conn = pool[index].connection;
+        QMetaObject::invokeMethod(conn, [conn, data]() {
+            conn->sendLine(data);
+        });
+    });
+    connect(sendQueue, &SendQueue::messageDelayed, this, [this](const QString& channel, qint64 delayMs) {
+        emit messageDelayed(channel.mid(1), delayMs);
+    });
+    connect(joinScheduler, &JoinScheduler::channelJoined, this, [this](const QString& channel, qint64 waitMs) {
+        emit channelJoined(channel.mid(1), waitMs);
+    });
+    connect(joinScheduler, &JoinScheduler::allJoined, this, &TwitchChat::joinsCompleted);
+    
+    rateClock.start();
 }
 
 TwitchChat::~TwitchChat() {
-    disconnect();
+    if (workerThread) {
+        for (const ConnectionSlot& slot : pool) {
+            QMetaObject::invokeMethod(slot.connection, &IrcConnection::close, Qt::BlockingQueuedConnection);
+        }
+        workerThread->quit();
+        workerThread->wait();
+    } else {
+        disconnect();
+    }
 }
 
-void TwitchChat::connectToChat(const QString& token, const QString& username) {
-    currentToken = token;
-    currentUsername = username;
+IrcConnection* TwitchChat::createConnection() {
+    IrcConnection* conn;
+    if (workerThread) {
+        conn = new IrcConnection();
+        conn->moveToThread(workerThread);
+        connect(workerThread, &QThread::finished, conn, &QObject::deleteLater);
+    } else {
+        conn = new IrcConnection(this);
+    }
+    
+    int index = pool.size();
+    connect(conn, &IrcConnection::connected, this, [this, index]() {
+        onConnected(index);
+    });
+    connect(conn, &IrcConnection::disconnected, this, [this, index]() {
+        onDisconnected(index);
+    });
+    connect(conn, &IrcConnection::connectionError, this, &TwitchChat::connectionError);
+    connect(conn, &IrcConnection::reconnectRequested, this, &TwitchChat::reconnectRequested);
+    connect(conn, &IrcConnection::reconnecting, this, &TwitchChat::reconnecting);
+    connect(conn, &IrcConnection::reconnected, this, [this](qint64 outageMs) {
+        reconnectCount++;
+        lastOutage = outageMs;
+        longestOutage = qMax(longestOutage, outageMs);
+        emit reconnected(outageMs);
+    });
+    
+    ConnectionSlot slot;
+    slot.connection = conn;
+    pool.append(slot);
+    
+    if (!currentToken.isEmpty()) {
+        openConnection(conn);
+    }
+    return conn;
+}
+
+void TwitchChat::openConnection(IrcConnection* conn) {
+    QString token = currentToken;
+    QString username = currentUsername;
+    QString host = serverHost;
+    quint16 port = serverPort;
+    
+    conn->setRawEnabled(Settings::instance().showRawIrc);
+    QMetaObject::invokeMethod(conn, [conn, token, username, host, port]() {
+        conn->open(token, username, host, port);
+    });
+}
+
+int TwitchChat::assignConnection(int handle) {
+    auto it = channelConnections.constFind(handle);
+    if (it != channelConnections.constEnd()) {
+        return it.value();
+    }
+    
+    int poolSize = qMax(1, Settings::instance().connectionPoolSize);
+    int channelLimit = qMax(1, Settings::instance().channelsPerConnection);
+    bool leastLoaded = Settings::instance().connectionPolicy == "least-loaded";
+    
+    int chosen = -1;
+    if (pool.size() < poolSize && (leastLoaded || nextConnection >= pool.size())) {
+        createConnection();
+        chosen = pool.size() - 1;
+    } else if (leastLoaded) {
+        for (int i = 0; i < pool.size(); ++i) {
+            if (pool[i].channelCount >= channelLimit) {
+                continue;
+            }
+            if (chosen < 0 || pool[i].messageRate < pool[chosen].messageRate ||
+                (pool[i].messageRate == pool[chosen].messageRate &&
+                 pool[i].channelCount < pool[chosen].channelCount)) {
+                chosen = i;
+            }
+        }
+    } else {
+        for (int tried = 0; tried < pool.size(); ++tried) {
+            int i = (nextConnection + tried) % pool.size();
+            if (pool[i].channelCount < channelLimit) {
+                chosen = i;
+                break;
+            }
+        }
+    }
     
-    socket->connectToHost("irc.chat.twitch.tv", 6667);
+    if (chosen < 0) {
+        createConnection();
+        chosen = pool.size() - 1;
+    }
+    
+    nextConnection = (chosen + 1) % poolSize;
+    pool[chosen].channelCount++;
+    channelConnections.insert(handle, chosen);
+    return chosen;
+}
+
+int TwitchChat::connectionFor(const QString& channel) {
+    int handle = channelHandle(channel);
+    int index = channelConnections.value(handle, -1);
+    if (index < 0) {
+        if (pool.isEmpty()) {
+            createConnection();
+        }
+        index = 0;
+    }
+    return index;
 }
 
-void TwitchChat::onConnected() {
-    socket->write("CAP REQ :twitch.tv/tags twitch.tv/commands\r\n");
-    socket->write(QString("PASS oauth:%1\r\n").arg(currentToken).toUtf8());
-    socket->write(QString("NICK %1\r\n").arg(currentUsername).toUtf8());
+void TwitchChat::connectToChat(const QString& token, const QString& username) {
+    currentToken = token;
+    currentUsername = username;
     
-    pingTimer->start();
-    emit connected();
+    if (pool.isEmpty()) {
+        createConnection();
+    } else {
+        for (const ConnectionSlot& slot : pool) {
+            openConnection(slot.connection);
+        }
+    }
+    frameTimer->start();
 }
 
-void TwitchChat::onDisconnected() {
-    pingTimer->stop();
-    emit disconnected();
+void TwitchChat::setServer(const QString& host, quint16 port) {
+    serverHost = host.isEmpty() ? QString("irc.chat.twitch.tv") : host;
+    serverPort = port ? port : 6667;
 }
 
-void TwitchChat::onError(QAbstractSocket::SocketError error) {
-    emit connectionError(socket->errorString());
+void TwitchChat::onConnected(int index) {
+    pool[index].connected = true;
+    sendQueue->resumeConnection(index);
+    
+    for (auto it = channelConnections.constBegin(); it != channelConnections.constEnd(); ++it) {
+        if (it.value() == index) {
+            joinScheduler->enqueue(index, "#" + channelNames[it.key()]);
+        }
+    }
+    
+    if (connectedCount++ == 0) {
+        emit connected();
+    }
 }
 
-void TwitchChat::handlePing() {
-    socket->write("PING :tmi.twitch.tv\r\n");
+void TwitchChat::onDisconnected(int index) {
+    drainEvents();
+    pool[index].connected = false;
+    joinScheduler->cancelConnection(index);
+    sendQueue->cancelConnection(index);
+    
+    connectedCount = qMax(0, connectedCount - 1);
+    if (connectedCount == 0) {
+        emit disconnected();
+    }
 }
 
 void TwitchChat::joinChannel(const QString& channel) {
@@ -61,7 +225,19 @@ void TwitchChat::joinChannel(const QString& channel) {
         ch = "#" + ch;
     }
     
-    socket->write(QString("JOIN %1\r\n").arg(ch).toUtf8());
+    if (joinedChannels.contains(ch)) {
+        return;
+    }
+    
+    int handle = channelHandle(ch);
+    int index = assignConnection(handle);
+    IrcConnection* conn = pool[index].connection;
+    QMetaObject::invokeMethod(conn, [conn, ch, handle]() {
+        conn->addChannel(ch, handle);
+    });
+    if (pool[index].connected) {
+        joinScheduler->enqueue(index, ch);
+    }
     joinedChannels.append(ch);
     
     updateChannelInfo(ch.mid(1));
@@ -73,7 +249,18 @@ void TwitchChat::leaveChannel(const QString& channel) {
         ch = "#" + ch;
     }
     
-    socket->write(QString("PART %1\r\n").arg(ch).toUtf8());
+    joinScheduler->cancel(ch);
+    
+    int handle = channelHandle(ch);
+    int index = channelConnections.value(handle, -1);
+    channelConnections.remove(handle);
+    if (index >= 0) {
+        IrcConnection* conn = pool[index].connection;
+        pool[index].channelCount--;
+        QMetaObject::invokeMethod(conn, [conn, ch]() {
+            conn->part(ch);
+        });
+    }
     joinedChannels.removeAll(ch);
 }
 
@@ -83,144 +270,223 @@ void TwitchChat::sendMessage(const QString& channel, const QString& message) {
         ch = "#" + ch;
     }
     
-    socket->write(QString("PRIVMSG %1 :%2\r\n").arg(ch).arg(message).toUtf8());
+    QByteArray text = message.toUtf8();
+    text.replace('\r', ' ').replace('\n', ' ');
+    
+    QByteArray line;
+    line.reserve(ch.size() + text.size() + 12);
+    line += "PRIVMSG ";
+    line += ch.toUtf8();
+    line += " :";
+    line += text;
+    line += "\r\n";
+    sendQueue->enqueue(connectionFor(ch), ch, line);
 }
 
 void TwitchChat::disconnect() {
-    if (socket->state() == QTcpSocket::ConnectedState) {
-        socket->disconnectFromHost();
+    for (const ConnectionSlot& slot : pool) {
+        QMetaObject::invokeMethod(slot.connection, &IrcConnection::close);
     }
 }
 
-void TwitchChat::onReadyRead() {
-    while (socket->canReadLine()) {
-        QString line = socket->readLine().trimmed();
-        
-        if (Settings::instance().showRawIrc) {
-            emit rawMessage(line);
-        }
-        
-        parseMessage(line);
-    }
+void TwitchChat::setFrameInterval(int ms) {
+    frameTimer->setInterval(qBound(1, ms, 1000));
 }
 
-void TwitchChat::parseMessage(const QString& line) {
-    if (line.startsWith("PING")) {
-        socket->write("PONG :tmi.twitch.tv\r\n");
-        return;
-    }
-    
-    if (line.contains("PRIVMSG")) {
-        ChatMessage msg = parsePrivMsg(line);
-        
-        QRegularExpression channelRe("#(\\w+)");
-        QRegularExpressionMatch match = channelRe.match(line);
-        if (match.hasMatch()) {
-            QString channel = match.captured(1);
-            emit messageReceived(channel, msg);
-        }
-    }
+int TwitchChat::channelHandle(const QString& channel) {
+    QString name = channel.startsWith('#') ? channel.mid(1).toLower() : channel.toLower();
     
-    if (line.contains("USERNOTICE")) {
-        QRegularExpression msgRe("USERNOTICE #(\\w+) :(.*)");
-        QRegularExpressionMatch match = msgRe.match(line);
-        if (match.hasMatch()) {
-            emit userNotice(match.captured(1), match.captured(2));
-        }
+    auto it = channelHandles.constFind(name);
+    if (it != channelHandles.constEnd()) {
+        return it.value();
     }
     
-    if (line.contains("CLEARMSG")) {
-        QRegularExpression idRe("target-msg-id=([^;\\s]+)");
-        QRegularExpressionMatch match = idRe.match(line);
-        if (match.hasMatch()) {
-        }
+    int handle = channelNames.size();
+    channelHandles.insert(name, handle);
+    channelNames.append(name);
+    pendingBatches.append(QList<ChatMessage>());
+    feeds.append(nullptr);
+    return handle;
+}
+
+ChannelFeed* TwitchChat::feed(const QString& channel) {
+    int handle = channelHandle(channel);
+    if (!feeds[handle]) {
+        feeds[handle] = new ChannelFeed(handle, channelNames[handle], this);
     }
+    return feeds[handle];
 }
 
-QMap<QString, QString> TwitchChat::parseTags(const QString& tags) {
-    QMap<QString, QString> result;
-    
-    QStringList pairs = tags.split(";");
-    for (const QString& pair : pairs) {
-        int eq = pair.indexOf("=");
-        if (eq > 0) {
-            QString key = pair.left(eq);
-            QString value = pair.mid(eq + 1);
-            result[key] = value;
-        }
+QString TwitchChat::channelName(int handle) const {
+    return channelNames.value(handle);
+}
+
+PipelineStats TwitchChat::pipelineStats() const {
+    PipelineStats stats;
+    stats.threaded = workerThread != nullptr;
+    stats.connections = pool.size();
+    for (const ConnectionSlot& slot : pool) {
+        SpscQueue<ChatEvent>& queue = slot.connection->events();
+        stats.queueDepth += queue.size();
+        stats.queueCapacity += queue.capacity();
+        stats.queueHighWater = qMax(stats.queueHighWater, queue.highWater());
+        stats.dropped += queue.dropped();
     }
-    
-    return result;
+    stats.sendQueueDepth = sendQueue->pendingCount();
+    stats.sendLastDelay = sendQueue->lastDelay();
+    stats.sendMaxDelay = sendQueue->maxDelay();
+    stats.reconnects = reconnectCount;
+    stats.lastOutage = lastOutage;
+    stats.longestOutage = longestOutage;
+    return stats;
 }
 
-ChatMessage TwitchChat::parsePrivMsg(const QString& line) {
-    ChatMessage msg;
-    
-    QRegularExpression re("^@([^\\s]+) :(\\w+)!\\w+@\\w+\\.tmi\\.twitch\\.tv PRIVMSG #\\w+ :(.*)$");
-    QRegularExpressionMatch match = re.match(line);
-    
-    if (!match.hasMatch()) {
-        return msg;
+void TwitchChat::flushBatch(int handle) {
+    if (pendingBatches[handle].isEmpty()) {
+        return;
     }
     
-    QString tags = match.captured(1);
-    msg.username = match.captured(2);
-    msg.text = match.captured(3);
-    msg.timestamp = QDateTime::currentDateTime();
+    QList<ChatMessage> batch;
+    batch.swap(pendingBatches[handle]);
     
-    QMap<QString, QString> tagMap = parseTags(tags);
+    qint64 now = Latency::now();
+    for (ChatMessage& msg : batch) {
+        msg.dispatchedAt = now;
+    }
+    if (feeds[handle]) {
+        emit feeds[handle]->messagesReceived(batch);
+    }
+    emit messagesReceived(handle, batch);
     
-    msg.id = tagMap.value("id");
-    msg.displayName = tagMap.value("display-name", msg.username);
-    msg.userId = tagMap.value("user-id");
+    batch.clear();
+    if (pendingBatches[handle].isEmpty()) {
+        pendingBatches[handle].swap(batch);
+    }
+}
+
+void TwitchChat::drainEvents() {
+    for (int i = 0; i < pool.size(); ++i) {
+        int messages = drainConnection(pool[i].connection);
+        pool[i].messages += messages;
+    }
     
-    QString colorStr = tagMap.value("color");
-    if (!colorStr.isEmpty()) {
-        msg.color = QColor(colorStr);
-    } else {
-        QStringList colors = {"#FF0000", "#0000FF", "#00FF00", "#B22222", "#FF7F50", 
-                             "#9ACD32", "#FF4500", "#2E8B57", "#DAA520", "#D2691E",
-                             "#5F9EA0", "#1E90FF", "#FF69B4", "#8A2BE2", "#00FF7F"};
-        int hash = 0;
-        for (QChar c : msg.username) {
-            hash = hash * 31 + c.unicode();
-        }
-        msg.color = QColor(colors[qAbs(hash) % colors.size()]);
+    for (int handle : dirtyChannels) {
+        flushBatch(handle);
     }
+    dirtyChannels.clear();
     
-    QString badgesStr = tagMap.value("badges");
-    if (!badgesStr.isEmpty()) {
-        QStringList badgePairs = badgesStr.split(",");
-        for (const QString& badge : badgePairs) {
-            msg.badges.append(badge.split("/")[0]);
+    qint64 elapsed = rateClock.elapsed();
+    if (elapsed >= 1000) {
+        for (ConnectionSlot& slot : pool) {
+            double rate = slot.messages * 1000.0 / elapsed;
+            slot.messageRate = slot.messageRate * 0.7 + rate * 0.3;
+            slot.messages = 0;
         }
+        rateClock.restart();
     }
-    
-    if (msg.text.startsWith("\x01" "ACTION")) {
-        msg.isAction = true;
-        msg.text = msg.text.mid(8);
-        if (msg.text.endsWith("\x01")) {
-            msg.text.chop(1);
+}
+
+int TwitchChat::drainConnection(IrcConnection* conn) {
+    int messages = 0;
+    ChatEvent event;
+    while (conn->events().pop(event)) {
+        int handle = event.channelId;
+        if (handle < 0 && !event.channel.isEmpty()) {
+            handle = channelHandle(event.channel);
+        }
+        
+        if (event.type == ChatEvent::Message) {
+            if (handle < 0) {
+                continue;
+            }
+            if (pendingBatches[handle].isEmpty()) {
+                dirtyChannels.append(handle);
+            }
+            pendingBatches[handle].append(std::move(event.message));
+            messages++;
+            continue;
+        }
+        
+        if (handle >= 0) {
+            flushBatch(handle);
+        }
+        
+        ChannelFeed* target = handle >= 0 ? feeds[handle] : nullptr;
+        QString channel = channelNames.value(handle);
+        
+        switch (event.type) {
+        case ChatEvent::Message:
+            break;
+        case ChatEvent::UserNotice:
+            if (target) {
+                emit target->userNotice(event.text);
+            }
+            emit userNotice(channel, event.text);
+            break;
+        case ChatEvent::MessageDeleted:
+            if (target) {
+                emit target->messageDeleted(event.text);
+            }
+            emit messageDeleted(channel, event.text);
+            break;
+        case ChatEvent::ChatCleared:
+            if (target) {
+                emit target->chatCleared(event.text);
+            }
+            emit chatCleared(channel, event.text);
+            break;
+        case ChatEvent::RoomState:
+            joinScheduler->confirm("#" + channel);
+            channelInfoCache[channel].channelId = event.text;
+            emit roomStateChanged(channel, event.text);
+            break;
+        case ChatEvent::UserState:
+            sendQueue->setModerator("#" + channel, event.text == "1");
+            break;
+        case ChatEvent::Joined:
+            joinScheduler->confirm("#" + channel);
+            break;
+        case ChatEvent::Raw:
+            emit rawMessage(event.text);
+            break;
         }
     }
-    
-    return msg;
+    return messages;
 }
 
 void TwitchChat::updateChannelInfo(const QString& channel) {
-    QUrl url(QString("https://api.twitch.tv/helix/streams?user_login=%1").arg(channel));
-    QNetworkRequest req(url);
-    req.setRawHeader("Authorization", QString("Bearer %1").arg(currentToken).toUtf8());
-    req.setRawHeader("Client-Id", TWITCH_APP_CLIENT_ID.toUtf8());
-    req.setProperty("channel", channel);
-    
-    QNetworkReply* reply = nam->get(req);
-    connect(reply, &QNetworkReply::finished, this, &TwitchChat::handleChannelInfoResponse);
+    if (!pendingInfoRequests.contains(channel)) {
+        pendingInfoRequests.append(channel);
+    }
+    if (!infoTimer->isActive()) {
+        infoTimer->start();
+    }
 }
 
-void TwitchChat::handleChannelInfoResponse(QNetworkReply* reply) {
-    QString channel = reply->property("channel").toString();
-    
+void TwitchChat::requestChannelInfo() {
+    while (!pendingInfoRequests.isEmpty()) {
+        QStringList channels = pendingInfoRequests.mid(0, 100);
+        pendingInfoRequests.remove(0, channels.size());
+        
+        QUrlQuery query;
+        for (const QString& channel : channels) {
+            query.addQueryItem("user_login", channel);
+        }
+        
+        QUrl url("https://api.twitch.tv/helix/streams");
+        url.setQuery(query);
+        QNetworkRequest req(url);
+        req.setRawHeader("Authorization", QString("Bearer %1").arg(currentToken).toUtf8());
+        req.setRawHeader("Client-Id", TWITCH_APP_CLIENT_ID.toUtf8());
+        
+        QNetworkReply* reply = nam->get(req);
+        connect(reply, &QNetworkReply::finished, this, [this, reply, channels]() {
+            handleChannelInfoResponse(reply, channels);
+        });
+    }
+}
+
+void TwitchChat::handleChannelInfoResponse(QNetworkReply* reply, const QStringList& channels) {
     if (reply->error() != QNetworkReply::NoError) {
         reply->deleteLater();
         return;
@@ -231,23 +497,35 @@ void TwitchChat::handleChannelInfoResponse(QNetworkReply* reply) {
     
     if (!doc.isObject()) return;
     
+    QHash<QString, QJsonObject> liveStreams;
     QJsonArray data = doc.object()["data"].toArray();
-    
-    ChannelInfo info;
-    info.channelName = channel;
-    
-    if (!data.isEmpty()) {
-        QJsonObject stream = data[0].toObject();
-        info.isLive = true;
-        info.viewerCount = stream["viewer_count"].toInt();
-        info.streamTitle = stream["title"].toString();
-        info.streamCategory = stream["game_name"].toString();
-    } else {
-        info.isLive = false;
+    for (const auto& item : data) {
+        QJsonObject stream = item.toObject();
+        liveStreams.insert(stream["user_login"].toString().toLower(), stream);
     }
     
-    channelInfoCache[channel] = info;
-    emit channelInfoUpdated(channel, info);
+    for (const QString& channel : channels) {
+        ChannelInfo info = channelInfoCache.value(channel);
+        info.channelName = channel;
+        
+        auto it = liveStreams.constFind(channel);
+        if (it != liveStreams.constEnd()) {
+            info.isLive = true;
+            info.viewerCount = it.value()["viewer_count"].toInt();
+            info.streamTitle = it.value()["title"].toString();
+            info.streamCategory = it.value()["game_name"].toString();
+        } else {
+            info.isLive = false;
+        }
+        
+        channelInfoCache[channel] = info;
+        
+        int handle = channelHandles.value(channel, -1);
+        if (handle >= 0 && feeds[handle]) {
+            emit feeds[handle]->channelInfoUpdated(info);
+        }
+        emit channelInfoUpdated(channel, info);
+    }
 }
 
 ChannelInfo TwitchChat::getChannelInfo(const QString& channel) {
@@ -2,18 +2,30 @@
 #define TWITCHCHAT_H
 
 #include <QObject>
-#include <QTcpSocket>
+#include <QThread>
 #include <QTimer>
+#include <QHash>
+#include <QElapsedTimer>
 #include "chatmessage.h"
+#include "channelfeed.h"
+#include "ircconnection.h"
+#include "joinscheduler.h"
+#include "sendqueue.h"
 #include <QNetworkAccessManager>
 
-struct ChannelInfo {
-    QString channelName;
-    QString channelId;
-    int viewerCount = 0;
-    QString streamTitle;
-    QString streamCategory;
-    bool isLive = false;
+struct PipelineStats {
+    bool threaded = false;
+    int connections = 0;
+    int queueDepth = 0;
+    int queueCapacity = 0;
+    int queueHighWater = 0;
+    quint64 dropped = 0;
+    int sendQueueDepth = 0;
+    qint64 sendLastDelay = 0;
+    qint64 sendMaxDelay = 0;
+    int reconnects = 0;
+    qint64 lastOutage = 0;
+    qint64 longestOutage = 0;
 };
 
 class TwitchChat : public QObject {
@@ -24,6 +36,7 @@ public:
     ~TwitchChat();
     
     void connectToChat(const QString& token, const QString& username);
+    void setServer(const QString& host, quint16 port);
     void joinChannel(const QString& channel);
     void leaveChannel(const QString& channel);
     void sendMessage(const QString& channel, const QString& message);
@@ -32,35 +45,81 @@ public:
     ChannelInfo getChannelInfo(const QString& channel);
     void updateChannelInfo(const QString& channel);
     
+    int channelHandle(const QString& channel);
+    QString channelName(int handle) const;
+    ChannelFeed* feed(const QString& channel);
+    void setFrameInterval(int ms);
+    
+    PipelineStats pipelineStats() const;
+    
 signals:
     void connected();
     void disconnected();
-    void messageReceived(const QString& channel, const ChatMessage& msg);
+    void messagesReceived(int channel, const QList<ChatMessage>& messages);
     void userNotice(const QString& channel, const QString& message);
+    void messageDeleted(const QString& channel, const QString& messageId);
+    void chatCleared(const QString& channel, const QString& userId);
+    void roomStateChanged(const QString& channel, const QString& roomId);
+    void reconnectRequested();
+    void reconnecting(int attempt, int delayMs);
+    void reconnected(qint64 outageMs);
+    void channelJoined(const QString& channel, qint64 waitMs);
+    void messageDelayed(const QString& channel, qint64 delayMs);
+    void joinsCompleted(int channels, qint64 elapsedMs);
     void channelInfoUpdated(const QString& channel, const ChannelInfo& info);
     void connectionError(const QString& error);
     void rawMessage(const QString& message);
     
 private slots:
-    void onConnected();
-    void onDisconnected();
-    void onReadyRead();
-    void onError(QAbstractSocket::SocketError error);
-    void handlePing();
-    void handleChannelInfoResponse(QNetworkReply* reply);
+    void drainEvents();
+    void requestChannelInfo();
     
 private:
-    QTcpSocket* socket;
-    QTimer* pingTimer;
+    struct ConnectionSlot {
+        IrcConnection* connection = nullptr;
+        bool connected = false;
+        int channelCount = 0;
+        quint64 messages = 0;
+        double messageRate = 0;
+    };
+    
+    QList<ConnectionSlot> pool;
+    QHash<int, int> channelConnections;
+    int nextConnection = 0;
+    int connectedCount = 0;
+    int reconnectCount = 0;
+    qint64 lastOutage = 0;
+    qint64 longestOutage = 0;
+    QElapsedTimer rateClock;
+    QThread* workerThread;
+    QTimer* frameTimer;
+    QTimer* infoTimer;
+    JoinScheduler* joinScheduler;
+    SendQueue* sendQueue;
+    QStringList pendingInfoRequests;
     QString currentToken;
     QString currentUsername;
+    QString serverHost;
+    quint16 serverPort;
     QStringList joinedChannels;
     QMap<QString, ChannelInfo> channelInfoCache;
     QNetworkAccessManager* nam;
     
-    void parseMessage(const QString& line);
-    ChatMessage parsePrivMsg(const QString& line);
-    QMap<QString, QString> parseTags(const QString& tags);
+    QHash<QString, int> channelHandles;
+    QStringList channelNames;
+    QList<QList<ChatMessage>> pendingBatches;
+    QList<ChannelFeed*> feeds;
+    QList<int> dirtyChannels;
+    
+    IrcConnection* createConnection();
+    void onConnected(int index);
+    void onDisconnected(int index);
+    void handleChannelInfoResponse(QNetworkReply* reply, const QStringList& channels);
+    void openConnection(IrcConnection* conn);
+    int assignConnection(int handle);
+    int connectionFor(const QString& channel);
+    int drainConnection(IrcConnection* conn);
+    void flushBatch(int handle);
 };
 
 #endif
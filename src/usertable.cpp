@@ -0,0 +1,238 @@
+#include "usertable.h"
+#include "irctags.h"
+#include <iterator>
+
+UserTable& UserTable::instance() {
+    static UserTable inst;
+    return inst;
+}
+
+UserTable::UserTable() {
+    for (std::atomic<Entry*>& chunk : chunks) {
+        chunk.store(nullptr, std::memory_order_relaxed);
+    }
+    
+    collectClock.start();
+    
+    // Handle 0 is the empty user, returned for unknown handles.
+    Source empty;
+    empty.pinned = true;
+    allocate(ChatUser(), std::move(empty));
+}
+
+UserTable::Entry& UserTable::entry(quint32 handle) const {
+    return chunks[handle >> ChunkShift].load(std::memory_order_acquire)[handle & (ChunkSize - 1)];
+}
+
+// Reuses a collected handle if there is one. The returned entry carries
+// the caller's reference. Only when every entry is referenced does a full
+// table give up and return the empty user.
+quint32 UserTable::allocate(ChatUser&& user, Source&& source) {
+    quint32 handle = count.load(std::memory_order_relaxed);
+    bool full = int(handle >> ChunkShift) >= MaxChunks;
+    if (freeHandles.isEmpty() && (full || collectClock.elapsed() >= CollectInterval)) {
+        collect();
+    }
+    
+    if (!freeHandles.isEmpty()) {
+        handle = freeHandles.takeLast();
+        Entry& slot = entry(handle);
+        slot.user = std::move(user);
+        slot.refs.store(1, std::memory_order_relaxed);
+        sources[handle] = std::move(source);
+        return handle;
+    }
+    if (full) {
+        return 0;
+    }
+    
+    int chunk = int(handle >> ChunkShift);
+    Entry* block = chunks[chunk].load(std::memory_order_relaxed);
+    if (!block) {
+        block = new Entry[ChunkSize];
+        chunks[chunk].store(block, std::memory_order_release);
+    }
+    Entry& slot = block[handle & (ChunkSize - 1)];
+    slot.user = std::move(user);
+    slot.refs.store(1, std::memory_order_relaxed);
+    sources.append(std::move(source));
+    count.store(handle + 1, std::memory_order_release);
+    return handle;
+}
+
+// Frees every unpinned entry nobody references. Called with the lock held,
+// which is the only place a reference to such an entry could come from.
+void UserTable::collect() {
+    collectClock.restart();
+    
+    quint32 end = count.load(std::memory_order_relaxed);
+    for (quint32 handle = 1; handle < end; ++handle) {
+        Source& source = sources[handle];
+        if (source.pinned || source.key.isEmpty() || entry(handle).refs.load(std::memory_order_acquire) > 0) {
+            continue;
+        }
+        
+        auto it = byKey.find(source.key);
+        if (it != byKey.end() && it.value() == handle) {
+            byKey.erase(it);
+        }
+        entry(handle).user = ChatUser();
+        source = Source();
+        freeHandles.append(handle);
+    }
+}
+
+const ChatUser& UserTable::user(quint32 handle) const {
+    if (handle >= count.load(std::memory_order_acquire)) {
+        handle = 0;
+    }
+    return entry(handle).user;
+}
+
+void UserTable::retain(quint32 handle) {
+    if (handle != 0 && handle < count.load(std::memory_order_acquire)) {
+        entry(handle).refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void UserTable::release(quint32 handle) {
+    if (handle != 0 && handle < count.load(std::memory_order_acquire)) {
+        entry(handle).refs.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+UserHandle UserTable::intern(QByteArrayView userId, QByteArrayView login, QByteArrayView displayName,
+                             QByteArrayView color, QByteArrayView badges) {
+    QMutexLocker locker(&mutex);
+    
+    // Lines without a user-id are keyed by login, prefixed so they can
+    // never collide with a numeric id.
+    QByteArray loginKey;
+    QByteArrayView key = userId;
+    if (key.isEmpty()) {
+        loginKey = "#" + login.toByteArray();
+        key = loginKey;
+    }
+    
+    auto it = byKey.constFind(QByteArray::fromRawData(key.data(), key.size()));
+    if (it != byKey.constEnd()) {
+        Source& source = sources[it.value()];
+        if (QByteArrayView(source.displayName) == displayName && QByteArrayView(source.color) == color &&
+            QByteArrayView(source.badges) == badges) {
+            entry(it.value()).refs.fetch_add(1, std::memory_order_relaxed);
+            return UserHandle(it.value());
+        }
+    }
+    
+    ChatUser user;
+    user.userId = QString::fromLatin1(userId);
+    user.login = QString::fromUtf8(login).toLower();
+    user.displayName = displayName.isEmpty() ? user.login : IrcTags::unescape(displayName);
+    user.badges = parseBadges(badges);
+    
+    if (!color.isEmpty()) {
+        user.color = QColor(QLatin1StringView(color));
+    }
+    if (!user.color.isValid()) {
+        static const QColor palette[] = {
+            QColor("#FF0000"), QColor("#0000FF"), QColor("#00FF00"), QColor("#B22222"), QColor("#FF7F50"),
+            QColor("#9ACD32"), QColor("#FF4500"), QColor("#2E8B57"), QColor("#DAA520"), QColor("#D2691E"),
+            QColor("#5F9EA0"), QColor("#1E90FF"), QColor("#FF69B4"), QColor("#8A2BE2"), QColor("#00FF7F")
+        };
+        quint32 hash = 0;
+        for (QChar c : user.login) {
+            hash = hash * 31 + c.unicode();
+        }
+        user.color = palette[hash % std::size(palette)];
+    }
+    user.readableName[0] = readableColor(user.color, true).name();
+    user.readableName[1] = readableColor(user.color, false).name();
+    
+    QByteArray keyBytes = key.toByteArray();
+    Source source;
+    source.key = keyBytes;
+    source.displayName = displayName.toByteArray();
+    source.color = color.toByteArray();
+    source.badges = badges.toByteArray();
+    
+    quint32 handle = allocate(std::move(user), std::move(source));
+    if (handle != 0) {
+        byKey.insert(keyBytes, handle);
+    }
+    return UserHandle(handle);
+}
+
+UserHandle UserTable::system(const QString& name, const QColor& color) {
+    QMutexLocker locker(&mutex);
+    
+    QByteArray key = "*" + name.toUtf8();
+    auto it = byKey.constFind(key);
+    if (it != byKey.constEnd()) {
+        return UserHandle(it.value());
+    }
+    
+    ChatUser user;
+    user.login = name;
+    user.displayName = name;
+    user.color = color;
+    user.readableName[0] = readableColor(color, true).name();
+    user.readableName[1] = readableColor(color, false).name();
+    
+    Source source;
+    source.key = key;
+    source.pinned = true;
+    
+    quint32 handle = allocate(std::move(user), std::move(source));
+    if (handle != 0) {
+        byKey.insert(key, handle);
+    }
+    return UserHandle(handle);
+}
+
+quint32 UserTable::parseBadges(QByteArrayView badges) {
+    quint32 mask = 0;
+    while (!badges.isEmpty()) {
+        qsizetype comma = badges.indexOf(',');
+        QByteArrayView badge = comma < 0 ? badges : badges.first(comma);
+        badges = comma < 0 ? QByteArrayView() : badges.sliced(comma + 1);
+        
+        qsizetype slash = badge.indexOf('/');
+        if (slash >= 0) {
+            badge = badge.first(slash);
+        }
+        
+        if (badge == "broadcaster") {
+            mask |= ChatUser::Broadcaster;
+        } else if (badge == "moderator") {
+            mask |= ChatUser::Moderator;
+        } else if (badge == "vip") {
+            mask |= ChatUser::Vip;
+        } else if (badge == "subscriber") {
+            mask |= ChatUser::Subscriber;
+        } else if (badge == "founder") {
+            mask |= ChatUser::Founder | ChatUser::Subscriber;
+        } else if (badge == "staff" || badge == "admin" || badge == "global_mod") {
+            mask |= ChatUser::Staff;
+        } else if (badge == "partner") {
+            mask |= ChatUser::Partner;
+        } else if (badge == "turbo") {
+            mask |= ChatUser::Turbo;
+        } else if (badge == "premium") {
+            mask |= ChatUser::Prime;
+        }
+    }
+    return mask;
+}
+
+// Nudges the HSL lightness so the name stays legible on the chat background.
+QColor UserTable::readableColor(const QColor& color, bool darkBackground) {
+    QColor hsl = color.toHsl();
+    float lightness = hsl.lightnessF();
+    if (darkBackground) {
+        lightness = qMax(lightness, 0.6f);
+    } else {
+        lightness = qMin(lightness, 0.4f);
+    }
+    hsl.setHslF(hsl.hslHueF(), hsl.hslSaturationF(), lightness);
+    return hsl.toRgb();
+}
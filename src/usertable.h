@@ -0,0 +1,133 @@
+#ifndef USERTABLE_H
+#define USERTABLE_H
+
+#include <QString>
+#include <QColor>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <atomic>
+#include <utility>
+
+struct ChatUser {
+    enum Badge : quint32 {
+        Broadcaster = 1 << 0,
+        Moderator = 1 << 1,
+        Vip = 1 << 2,
+        Subscriber = 1 << 3,
+        Founder = 1 << 4,
+        Staff = 1 << 5,
+        Partner = 1 << 6,
+        Turbo = 1 << 7,
+        Prime = 1 << 8
+    };
+    
+    QString userId;
+    QString login;
+    QString displayName;
+    QColor color;
+    QString readableName[2];
+    quint32 badges = 0;
+    
+    bool hasBadge(Badge badge) const { return badges & badge; }
+    const QString& colorName(bool darkBackground) const { return readableName[darkBackground ? 0 : 1]; }
+};
+
+class UserHandle;
+
+// Interned chatter identities. Messages carry a 32-bit handle into this
+// table instead of their own name, color and badge strings. Entries are
+// immutable while referenced: a user whose name, color or badges change
+// gets a new handle, so user() needs no lock and older messages keep the
+// look they were sent with. intern() may be called from the network thread.
+//
+// Every handle in use is counted: messages hold a UserHandle, and message
+// stores retain() the raw handles in their records until eviction. A new
+// reference to an unreferenced entry is only ever taken by intern() under
+// the lock, so an entry at zero cannot be reached by any reader and is
+// free to reuse. Collection runs from intern() every CollectInterval while
+// there are no free handles, which bounds the table by what is still in
+// flight or resident instead of by everyone who ever chatted.
+class UserTable {
+public:
+    static UserTable& instance();
+    
+    UserHandle intern(QByteArrayView userId, QByteArrayView login, QByteArrayView displayName,
+                      QByteArrayView color, QByteArrayView badges);
+    UserHandle system(const QString& name, const QColor& color);
+    const ChatUser& user(quint32 handle) const;
+    void retain(quint32 handle);
+    void release(quint32 handle);
+    int size() const { return int(count.load(std::memory_order_acquire)); }
+    
+    static quint32 parseBadges(QByteArrayView badges);
+    static QColor readableColor(const QColor& color, bool darkBackground);
+    
+private:
+    static constexpr int ChunkShift = 10;
+    static constexpr int ChunkSize = 1 << ChunkShift;
+    static constexpr int MaxChunks = 4096;
+    static constexpr qint64 CollectInterval = 10000;
+    
+    struct Entry {
+        ChatUser user;
+        std::atomic<qint32> refs{0};
+    };
+    
+    // Guarded by mutex. An empty key marks a free entry; pinned entries
+    // (the empty user and system users) are never collected.
+    struct Source {
+        QByteArray key;
+        QByteArray displayName;
+        QByteArray color;
+        QByteArray badges;
+        bool pinned = false;
+    };
+    
+    UserTable();
+    Entry& entry(quint32 handle) const;
+    quint32 allocate(ChatUser&& user, Source&& source);
+    void collect();
+    
+    std::atomic<Entry*> chunks[MaxChunks];
+    std::atomic<quint32> count{0};
+    QMutex mutex;
+    QHash<QByteArray, quint32> byKey;
+    QList<Source> sources;
+    QList<quint32> freeHandles;
+    QElapsedTimer collectClock;
+};
+
+// A counted reference to a UserTable entry; the entry stays as it is for as
+// long as any copy exists. Assigning a raw handle takes a new reference,
+// which is only valid while something else already holds one, such as the
+// store record the handle was read from.
+class UserHandle {
+public:
+    UserHandle() = default;
+    UserHandle(const UserHandle& other) : value(other.value) { UserTable::instance().retain(value); }
+    UserHandle(UserHandle&& other) noexcept : value(std::exchange(other.value, 0)) {}
+    ~UserHandle() { UserTable::instance().release(value); }
+    
+    UserHandle& operator=(const UserHandle& other) { return *this = quint32(other.value); }
+    UserHandle& operator=(UserHandle&& other) noexcept {
+        std::swap(value, other.value);
+        return *this;
+    }
+    UserHandle& operator=(quint32 handle) {
+        UserTable::instance().retain(handle);
+        UserTable::instance().release(value);
+        value = handle;
+        return *this;
+    }
+    
+    operator quint32() const { return value; }
+    
+private:
+    friend class UserTable;
+    explicit UserHandle(quint32 adopted) : value(adopted) {}
+    
+    quint32 value = 0;
+};
+
+#endif